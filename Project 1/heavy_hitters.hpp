@@ -0,0 +1,249 @@
+/*
+ * Space-Saving heavy hitters.
+ * Keeps a fixed number of counters. An unseen term takes over the counter with the smallest count
+ * and inherits that count as its error, so every count overestimates the true frequency by at most
+ * its error and at most total / counters. Counters sit in a min-heap ordered by count and are
+ * found through an open-addressing table of counter indices. Summaries of different chunks merge
+ * with the same guarantees. Counters hold their terms as InlineTerm values, so replacing a counter
+ * copies the term into it without touching the heap; only terms too long to fit are kept in
+ * strings of their own.
+ */
+
+#ifndef HEAVY_HITTERS_HPP
+#define HEAVY_HITTERS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../common/hash.hpp"
+#include "../common/inline_term.hpp"
+
+// One reported term, its true count lies in [count - error, count]
+struct HeavyHitter {
+    std::string_view term;
+    uint64_t count;
+    uint64_t error;
+};
+
+class SpaceSaving {
+    struct Counter {
+        InlineTerm term;
+        uint64_t count;
+        uint64_t error;
+    };
+
+    std::vector<Counter> counters;
+    std::unordered_map<uint32_t, std::string> outside_terms;    // Bytes of the long terms, by counter
+    std::vector<uint32_t> heap;             // Counter indices, smallest count first
+    std::vector<uint32_t> heap_position;    // Position of each counter in heap
+    std::vector<uint32_t> slots;            // Counter index + 1, 0 marks an empty slot
+    size_t slot_mask = 0;
+    size_t max_counters = 0;
+    uint64_t total_count = 0;
+
+    bool less(uint32_t a, uint32_t b) const { return counters[a].count < counters[b].count; }
+
+    void place(size_t position, uint32_t counter) {
+        heap[position] = counter;
+        heap_position[counter] = (uint32_t) position;
+    }
+
+    void siftUp(size_t position) {
+        uint32_t counter = heap[position];
+        while (position > 0 && less(counter, heap[(position - 1) / 2])) {
+            place(position, heap[(position - 1) / 2]);
+            position = (position - 1) / 2;
+        }
+        place(position, counter);
+    }
+
+    void siftDown(size_t position) {
+        uint32_t counter = heap[position];
+        for (size_t child = 2 * position + 1; child < heap.size(); child = 2 * position + 1) {
+            if (child + 1 < heap.size() && less(heap[child + 1], heap[child])) child++;
+            if (!less(heap[child], counter)) break;
+            place(position, heap[child]);
+            position = child;
+        }
+        place(position, counter);
+    }
+
+    // Returns the slot holding term, or the empty slot where it belongs
+    size_t findSlot(const InlineTerm& term) const {
+        size_t slot = term.hash() & slot_mask;
+        while (slots[slot] != 0 && !(counters[slots[slot] - 1].term == term)) slot = (slot + 1) & slot_mask;
+        return slot;
+    }
+
+    // Gives counter its term, copying a long term's bytes into a string the summary owns
+    void setTerm(uint32_t counter, const InlineTerm& term) {
+        if (term.is_inline()) {
+            if (!counters[counter].term.is_inline()) outside_terms.erase(counter);
+            counters[counter].term = term;
+            return;
+        }
+        std::string& bytes = outside_terms[counter];
+        bytes.assign(term.view().data(), term.view().size());
+        counters[counter].term = InlineTerm(bytes, term.hash());
+    }
+
+    // Empties a slot and shifts later entries of its probe run back, so no tombstones are needed
+    void eraseSlot(size_t slot) {
+        size_t next = (slot + 1) & slot_mask;
+        while (slots[next] != 0) {
+            size_t home = counters[slots[next] - 1].term.hash() & slot_mask;
+            // Move the entry back if its home is not in the cyclic range (slot, next]
+            if (((next - home) & slot_mask) >= ((next - slot) & slot_mask)) {
+                slots[slot] = slots[next];
+                slot = next;
+            }
+            next = (next + 1) & slot_mask;
+        }
+        slots[slot] = 0;
+    }
+
+    // Rebuilds the table and heap after counters changed wholesale. Long terms are copied again
+    // by their new counter index, they may still point into another summary.
+    void rebuild() {
+        std::unordered_map<uint32_t, std::string> old_outside_terms;
+        old_outside_terms.swap(outside_terms);
+        std::fill(slots.begin(), slots.end(), 0);
+        heap.resize(counters.size());
+        heap_position.resize(counters.size());
+        for (uint32_t i = 0; i < counters.size(); i++) {
+            if (!counters[i].term.is_inline()) setTerm(i, counters[i].term);
+            slots[findSlot(counters[i].term)] = i + 1;
+            place(i, i);
+        }
+        for (size_t i = heap.size() / 2; i-- > 0;) siftDown(i);
+    }
+
+    public:
+        // Bytes taken by one counter, not counting terms longer than INLINE_TERM_CAPACITY
+        static constexpr size_t COUNTER_BYTES = sizeof(Counter) + 4 * sizeof(uint32_t);
+
+        // Uses as many counters as fit in memory_budget bytes, 0 counters disables the summary
+        explicit SpaceSaving(size_t memory_budget = 0) {
+            max_counters = memory_budget / COUNTER_BYTES;
+            if (max_counters == 0) return;
+            counters.reserve(max_counters);
+            heap.reserve(max_counters);
+            heap_position.reserve(max_counters);
+            size_t slot_count = 1;
+            while (slot_count < 2 * max_counters) slot_count *= 2;
+            slots.assign(slot_count, 0);
+            slot_mask = slot_count - 1;
+        }
+
+        SpaceSaving(SpaceSaving&&) = default;
+        SpaceSaving& operator=(SpaceSaving&&) = default;
+
+        // Counts weight occurrences of term. A long term's bytes need only last for the call.
+        void add(const InlineTerm& term, uint64_t weight = 1) {
+            if (max_counters == 0) return;
+            total_count += weight;
+            size_t slot = findSlot(term);
+            if (slots[slot] != 0) {
+                uint32_t counter = slots[slot] - 1;
+                counters[counter].count += weight;
+                siftDown(heap_position[counter]);
+                return;
+            }
+            if (counters.size() < max_counters) {
+                uint32_t counter = (uint32_t) counters.size();
+                counters.push_back(Counter{InlineTerm(), weight, 0});
+                setTerm(counter, term);
+                slots[slot] = counter + 1;
+                heap.push_back(counter);
+                heap_position.push_back(0);
+                siftUp(heap.size() - 1);
+                return;
+            }
+
+            // Replace the smallest counter, its count bounds how often term may have been missed
+            uint32_t counter = heap[0];
+            Counter& c = counters[counter];
+            eraseSlot(findSlot(c.term));
+            setTerm(counter, term);
+            c.error = c.count;
+            c.count += weight;
+            slots[findSlot(c.term)] = counter + 1;
+            siftDown(0);
+        }
+
+        // Counts weight occurrences of term
+        void add(std::string_view term, uint64_t weight = 1) { add(InlineTerm(term), weight); }
+
+        // Folds in the summary of another part of the stream. A term missing from one summary is
+        // charged that summary's smallest count as both count and error, so the bounds still hold.
+        void merge(const SpaceSaving& other) {
+            if (max_counters == 0) return;
+            uint64_t own_min = min_count(), other_min = other.min_count();
+            std::vector<bool> matched (other.counters.size(), false);
+            for (Counter& c : counters) {
+                size_t slot = other.slots.empty() ? 0 : other.findSlot(c.term);
+                if (!other.slots.empty() && other.slots[slot] != 0) {
+                    const Counter& o = other.counters[other.slots[slot] - 1];
+                    matched[other.slots[slot] - 1] = true;
+                    c.count += o.count;
+                    c.error += o.error;
+                }
+                else {
+                    c.count += other_min;
+                    c.error += other_min;
+                }
+            }
+            for (size_t i = 0; i < other.counters.size(); i++) {
+                if (matched[i]) continue;
+                const Counter& o = other.counters[i];
+                counters.push_back(Counter{o.term, o.count + own_min, o.error + own_min});
+            }
+            total_count += other.total_count;
+
+            // Keep the largest counts
+            if (counters.size() > max_counters) {
+                std::nth_element(counters.begin(), counters.begin() + max_counters, counters.end(),
+                                 [](const Counter& a, const Counter& b) { return a.count > b.count; });
+                counters.resize(max_counters);
+            }
+            rebuild();
+        }
+
+        // Returns the k largest counts, ties broken by term
+        std::vector<HeavyHitter> top(size_t k) const {
+            std::vector<HeavyHitter> result;
+            result.reserve(counters.size());
+            for (const Counter& c : counters) result.push_back(HeavyHitter{c.term.view(), c.count, c.error});
+            k = std::min(k, result.size());
+            std::partial_sort(result.begin(), result.begin() + k, result.end(), [](const HeavyHitter& a, const HeavyHitter& b) {
+                return a.count > b.count || (a.count == b.count && a.term < b.term);
+            });
+            result.resize(k);
+            return result;
+        }
+
+        // Returns the count an unmonitored term may have reached, 0 until every counter is in use
+        uint64_t min_count() const { return counters.size() < max_counters || heap.empty() ? 0 : counters[heap[0]].count; }
+
+        // Returns the number of occurrences counted
+        uint64_t total() const { return total_count; }
+
+        // Returns the number of counters
+        size_t capacity() const { return max_counters; }
+
+        // Returns the bytes held by the summary
+        size_t memory() const {
+            size_t bytes = max_counters * COUNTER_BYTES;
+            if (!outside_terms.empty()) bytes += outside_terms.bucket_count() * sizeof(void*);
+            for (const auto& entry : outside_terms) {
+                // A map node and the heap buffer of the string
+                bytes += sizeof(void*) + sizeof(entry) + entry.second.capacity() + 1;
+            }
+            return bytes;
+        }
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * HyperLogLog distinct-term counter.
+ * A term's 64-bit hash picks one of 2^precision registers with its top bits, and the register keeps
+ * the largest rank (leading zeros + 1) seen in the remaining bits. The estimate has a relative
+ * standard error of about 1.04 / sqrt(2^precision) in constant memory. The harmonic sum and the
+ * number of empty registers are kept up to date, so estimate() costs O(1) and a growth curve can
+ * be read off after every insertion. Sketches of different chunks merge by taking register maxima.
+ */
+
+#ifndef HYPERLOGLOG_HPP
+#define HYPERLOGLOG_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "../common/hash.hpp"
+
+const int HLL_MIN_PRECISION = 4;
+const int HLL_MAX_PRECISION = 18;
+
+class HyperLogLog {
+    std::vector<uint8_t> registers;
+    int precision;
+    double inverse_sum;         // Sum of 2^-register over all registers
+    size_t empty_registers;
+
+    public:
+        explicit HyperLogLog(int precision)
+            : registers(size_t(1) << precision, 0), precision(precision), inverse_sum((double) registers.size()),
+              empty_registers(registers.size()) {}
+
+        // Returns the register and rank a hash maps to
+        size_t index(uint64_t h) const { return h >> (64 - precision); }
+        uint8_t rank(uint64_t h) const {
+            uint64_t rest = (h << precision) | (uint64_t(1) << (precision - 1));
+            return (uint8_t) (__builtin_clzll(rest) + 1);
+        }
+
+        // Raises register i to at least value, returns true if it changed
+        bool raise(size_t i, uint8_t value) {
+            if (value <= registers[i]) return false;
+            if (registers[i] == 0) empty_registers--;
+            inverse_sum += std::ldexp(1.0, -value) - std::ldexp(1.0, -registers[i]);
+            registers[i] = value;
+            return true;
+        }
+
+        // Adds a term by its hash, returns true if the sketch changed
+        bool add_hash(uint64_t h) { return raise(index(h), rank(h)); }
+
+        bool add(std::string_view term) { return add_hash(hash_bytes(term.data(), term.size())); }
+
+        // Takes the union with another sketch of the same precision
+        void merge(const HyperLogLog& other) {
+            for (size_t i = 0; i < registers.size(); i++) raise(i, other.registers[i]);
+        }
+
+        // Returns the estimated number of distinct terms added
+        double estimate() const {
+            double m = (double) registers.size();
+            double alpha = m >= 128 ? 0.7213 / (1 + 1.079 / m) : m >= 64 ? 0.709 : m >= 32 ? 0.697 : 0.673;
+            double raw = alpha * m * m / inverse_sum;
+            // Linear counting is more accurate while many registers are still empty
+            if (raw <= 2.5 * m && empty_registers > 0) return m * std::log(m / empty_registers);
+            return raw;
+        }
+
+        // Returns log2 of the number of registers
+        int bits() const { return precision; }
+
+        // Returns the bytes held by the sketch
+        size_t memory() const { return registers.size(); }
+};
+
+#endif
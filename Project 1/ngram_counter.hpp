@@ -0,0 +1,315 @@
+/*
+ * Word n-gram and character shingle counting in bounded memory.
+ * An n-gram is a fixed number of 32-bit symbols (term ids, or shingle bytes packed four to a word)
+ * hashed with a polynomial rolling hash that is updated as the window slides, so no n-gram string
+ * is built. Counts live in one flat open-addressing array of records [hash, count, symbols...], the
+ * hash and the 64-bit count two words each; a count of 0 marks an empty record. When the table has
+ * reached its memory budget and fills up, its records are sorted and spilled to a temporary file as
+ * a run. finish() merges the runs with what is left in memory, adds up the counts of equal n-grams
+ * and reports those reaching a minimum frequency. A temporary file that cannot be written or read
+ * back completely is reported by failed() rather than giving truncated counts.
+ */
+
+#ifndef NGRAM_COUNTER_HPP
+#define NGRAM_COUNTER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <vector>
+#include "../common/hash.hpp"
+
+// Polynomial hash of the last n symbols pushed, sum of h(symbol) * BASE^age, kept up to date in O(1)
+class RollingHash {
+    static constexpr uint64_t BASE = 0x100000001b3ULL;
+    std::vector<uint64_t> window;
+    size_t next = 0;
+    size_t filled = 0;
+    uint64_t value = 0;
+    uint64_t drop_power = 1;    // BASE^n, the weight of the symbol leaving the window
+
+    public:
+        explicit RollingHash(size_t n) : window(std::max<size_t>(n, 1), 0) {
+            for (size_t i = 0; i < window.size(); i++) drop_power *= BASE;
+        }
+
+        void push(uint64_t symbol) {
+            uint64_t h = mix64(symbol + 1);
+            value = value * BASE + h;
+            if (filled == window.size()) value -= window[next] * drop_power;
+            else filled++;
+            window[next] = h;
+            next = (next + 1) % window.size();
+        }
+
+        // Starts over with an empty window
+        void reset() {
+            next = 0;
+            filled = 0;
+            value = 0;
+        }
+
+        // Returns true once n symbols have been pushed since the last reset
+        bool full() const { return filled == window.size(); }
+
+        uint64_t hash() const { return mix64(value); }
+};
+
+// Runs kept open at once, more are merged into one
+const size_t NGRAM_MAX_RUNS = 64;
+
+// Smallest table, in slots; a smaller budget is rejected rather than exceeded
+const size_t NGRAM_MIN_SLOTS = 1024;
+
+class NgramCounter {
+    // Reads a sorted run back a buffer of records at a time
+    struct RunReader {
+        FILE* file;
+        std::vector<uint32_t> buffer;
+        size_t pos = 0;
+        size_t end = 0;
+
+        // Reads the next buffer of records, returns false at the end of the run or on a read error
+        bool fill(size_t record) {
+            end = fread(buffer.data(), sizeof(uint32_t), buffer.size(), file);
+            pos = 0;
+            return end >= record;
+        }
+
+        // Moves to the next record, returns false at the end of the run or on a read error
+        bool advance(size_t record) {
+            pos += record;
+            return pos < end || fill(record);
+        }
+
+        // Returns true if the run ended anywhere but after its last whole record
+        bool failed(size_t record) const { return ferror(file) || end % record != 0; }
+    };
+
+    size_t width;                   // Symbols per n-gram
+    size_t record;                  // 32-bit words per record: hash (2), count (2), symbols
+    std::vector<uint32_t> table;
+    size_t slot_mask = 0;
+    size_t used = 0;
+    size_t max_slots;
+    std::vector<FILE*> runs;
+    size_t spill_count = 0;
+    uint64_t spilled_records = 0;
+    uint64_t added = 0;
+    bool io_error = false;
+
+    static uint64_t hashOf(const uint32_t* r) { return (uint64_t) r[1] << 32 | r[0]; }
+    static uint64_t countOf(const uint32_t* r) { return (uint64_t) r[3] << 32 | r[2]; }
+    static bool isEmpty(const uint32_t* r) { return (r[2] | r[3]) == 0; }
+
+    static void setCount(uint32_t* r, uint64_t count) {
+        r[2] = (uint32_t) count;
+        r[3] = (uint32_t) (count >> 32);
+    }
+
+    // Orders records by hash, then symbols, so equal n-grams are adjacent in every run
+    bool less(const uint32_t* a, const uint32_t* b) const {
+        if (hashOf(a) != hashOf(b)) return hashOf(a) < hashOf(b);
+        return std::lexicographical_compare(a + 4, a + record, b + 4, b + record);
+    }
+
+    bool same(const uint32_t* a, const uint32_t* b) const {
+        return hashOf(a) == hashOf(b) && std::equal(a + 4, a + record, b + 4);
+    }
+
+    // Appends a record to a run, noting a short write
+    void writeRecord(const uint32_t* r, FILE* run) {
+        if (fwrite(r, sizeof(uint32_t), record, run) != record) io_error = true;
+    }
+
+    void allocate(size_t slots) {
+        table.assign(slots * record, 0);
+        slot_mask = slots - 1;
+        used = 0;
+    }
+
+    // Returns the record holding the n-gram, or the empty record where it belongs
+    uint32_t* find(uint64_t hash, const uint32_t* symbols) {
+        for (size_t slot = hash & slot_mask;; slot = (slot + 1) & slot_mask) {
+            uint32_t* r = &table[slot * record];
+            if (isEmpty(r) || (hashOf(r) == hash && std::equal(symbols, symbols + width, r + 4))) return r;
+        }
+    }
+
+    void grow() {
+        std::vector<uint32_t> old;
+        old.swap(table);
+        allocate(2 * (slot_mask + 1));
+        for (size_t i = 0; i < old.size(); i += record) {
+            if (isEmpty(&old[i])) continue;
+            std::copy(&old[i], &old[i] + record, find(hashOf(&old[i]), &old[i + 4]));
+            used++;
+        }
+    }
+
+    // Moves the records to the front of the table and returns their order
+    std::vector<uint32_t> sortRecords() {
+        size_t count = 0;
+        for (size_t i = 0; i < table.size(); i += record) {
+            if (isEmpty(&table[i])) continue;
+            if (i != count * record) std::copy(&table[i], &table[i] + record, &table[count * record]);
+            count++;
+        }
+        std::vector<uint32_t> order (count);
+        for (size_t i = 0; i < count; i++) order[i] = (uint32_t) i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return less(&table[a * record], &table[b * record]); });
+        return order;
+    }
+
+    // Merges every run, calling emit(record, count) once per distinct n-gram in order, and closes them.
+    // A run that cannot be read back completely sets io_error.
+    template <class Emit>
+    void mergeRuns(Emit emit) {
+        std::vector<RunReader> readers;
+        for (FILE* run : runs) {
+            rewind(run);
+            RunReader reader {run, std::vector<uint32_t>(record * 4096)};
+            if (reader.fill(record)) readers.push_back(std::move(reader));
+            else if (reader.failed(record)) io_error = true;
+        }
+        auto later = [&](size_t a, size_t b) {
+            return less(&readers[b].buffer[readers[b].pos], &readers[a].buffer[readers[a].pos]);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap (later);
+        for (size_t i = 0; i < readers.size(); i++) heap.push(i);
+
+        std::vector<uint32_t> current (record);
+        uint64_t count = 0;
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            const uint32_t* r = &readers[i].buffer[readers[i].pos];
+            if (count > 0 && same(r, current.data())) count += countOf(r);
+            else {
+                if (count > 0) emit(current.data(), count);
+                std::copy(r, r + record, current.begin());
+                count = countOf(r);
+            }
+            if (readers[i].advance(record)) heap.push(i);
+            else if (readers[i].failed(record)) io_error = true;
+        }
+        if (count > 0) emit(current.data(), count);
+        for (FILE* run : runs) fclose(run);
+        runs.clear();
+    }
+
+    // Writes the table to a new sorted run and empties it, returns false if no temporary file could be
+    // made. A short write sets io_error.
+    bool spill() {
+        FILE* run = tmpfile();
+        if (!run) return false;
+        std::vector<uint32_t> order = sortRecords();
+        for (uint32_t i : order) writeRecord(&table[i * record], run);
+        if (fflush(run) != 0) io_error = true;
+        runs.push_back(run);
+        spilled_records += order.size();
+        spill_count++;
+        std::fill(table.begin(), table.end(), 0);
+        used = 0;
+
+        // Fold the runs into one before they use up the open file limit, trying again at the next
+        // spill if no temporary file can be made now
+        if (runs.size() >= NGRAM_MAX_RUNS) {
+            FILE* merged = tmpfile();
+            if (!merged) return true;
+            std::vector<uint32_t> folded (record);
+            mergeRuns([&](const uint32_t* r, uint64_t count) {
+                std::copy(r, r + record, folded.begin());
+                setCount(folded.data(), count);
+                writeRecord(folded.data(), merged);
+            });
+            if (fflush(merged) != 0) io_error = true;
+            runs.push_back(merged);
+        }
+        return true;
+    }
+
+    public:
+        // Counts n-grams of width symbols in at most memory_budget bytes of table, which must be at
+        // least min_memory(width)
+        NgramCounter(size_t width, size_t memory_budget) : width(width), record(4 + width) {
+            max_slots = NGRAM_MIN_SLOTS;
+            while (max_slots * 2 * record * sizeof(uint32_t) <= memory_budget) max_slots *= 2;
+            allocate(std::min<size_t>(max_slots, 1 << 16));
+        }
+
+        ~NgramCounter() {
+            for (FILE* run : runs) fclose(run);
+        }
+
+        NgramCounter(const NgramCounter&) = delete;
+        NgramCounter& operator=(const NgramCounter&) = delete;
+
+        // Counts one occurrence of the n-gram symbols[0, width) with the given hash
+        void add(uint64_t hash, const uint32_t* symbols) {
+            added++;
+            if (10 * (used + 1) > 7 * (slot_mask + 1)) {
+                // Without a temporary file the only way on is past the budget
+                if (slot_mask + 1 < max_slots) grow();
+                else if (!spill()) {
+                    max_slots *= 2;
+                    grow();
+                }
+            }
+            uint32_t* r = find(hash, symbols);
+            if (isEmpty(r)) {
+                r[0] = (uint32_t) hash;
+                r[1] = (uint32_t) (hash >> 32);
+                std::copy(symbols, symbols + width, r + 4);
+                used++;
+            }
+            setCount(r, countOf(r) + 1);
+        }
+
+        // Calls emit(symbols, count) for every distinct n-gram counted at least min_count times, in
+        // hash order, and returns how many there were. Every run is consumed, so call it once, and
+        // check failed() afterwards.
+        template <class Emit>
+        uint64_t finish(uint64_t min_count, Emit emit) {
+            uint64_t emitted = 0;
+            auto keep = [&](const uint32_t* r, uint64_t count) {
+                if (count < min_count) return;
+                emit(r + 4, count);
+                emitted++;
+            };
+            if (runs.empty()) {
+                for (uint32_t i : sortRecords()) keep(&table[i * record], countOf(&table[i * record]));
+                return emitted;
+            }
+
+            // Merge the runs, the records still in memory becoming the last one
+            if (used > 0 && !spill()) {
+                io_error = true;
+                return 0;
+            }
+            table.clear();
+            table.shrink_to_fit();
+            mergeRuns(keep);
+            return emitted;
+        }
+
+        // Returns the number of n-gram occurrences counted
+        uint64_t total() const { return added; }
+
+        // Returns true if a run could not be made, written or read back, so the counts are incomplete
+        bool failed() const { return io_error; }
+
+        // Returns the number of times the table was spilled to disk and the records written
+        size_t spills() const { return spill_count; }
+        uint64_t spilled() const { return spilled_records; }
+
+        // Returns the largest table size allowed, in bytes
+        size_t memory() const { return max_slots * record * sizeof(uint32_t); }
+
+        // Returns the smallest budget a table of n-grams of width symbols fits in, in bytes
+        static size_t min_memory(size_t width) { return NGRAM_MIN_SLOTS * (4 + width) * sizeof(uint32_t); }
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * The original tokenizer's string-based steps, kept as they were written: abbreviation folding,
+ * punctuation removal, tokenizing and Porter stemming (steps 1a and 1b). Nothing counts terms with
+ * them any more; they are the reference the rewrites are fuzzed against (-fuzz-abbreviations) and
+ * timed against (-bench-stem and the TokenizationBench suite).
+ */
+
+#ifndef REFERENCE_TOKENIZER_HPP
+#define REFERENCE_TOKENIZER_HPP
+
+#include <cctype>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+#include "../common/char_classes.hpp"
+
+inline const std::set<char> ORIGINAL_VOWELS = {'a', 'e', 'i', 'o', 'u'};
+
+// The original abbreviation folding
+inline std::string abbreviate(std::string& s) {
+    bool ab = false;
+    int curr = 0;
+    while (curr < s.length()) {
+        if (s[curr] == '.' && curr + 2 < s.length() && s[curr + 2] == '.') {
+            s.erase(s.begin() + curr);
+            ab = true;
+        } else if (ab) {
+            s.erase(s.begin() + curr);
+            ab = false;
+        }
+        curr++;
+    }
+    return s;
+}
+
+// The original punctuation removal: keeps s up to its first non-alphanumeric byte and queues the
+// rest in input, to be split again later
+inline std::string removePunc(std::string s, std::vector<std::string>& input) {
+    for (int i = 0; i < s.length(); i++) {
+        if (!isalnum(s[i])) {
+            if (i + 1 < s.length()) input.push_back(s.substr(i + 1));
+            s = s.substr(0, i);
+            i--;
+        }
+    }
+    return s;
+}
+
+// Tokenizes like the original program: split at whitespace, abbreviate() each word, then split
+// at non-alphanumeric characters. Each byte keeps the class and lowercase form of the UTF-8 code
+// point it belongs to where it stands in the text, found by decoding the text from the start.
+inline std::vector<std::string> referenceTokens(const std::string& text, bool lowercase) {
+    const UnicodeClasses& classes = unicode_classes();
+    std::vector<bool> word_byte (text.size());
+    std::string lowered = text;
+    for (size_t i = 0; i < text.size();) {
+        uint32_t cp;
+        size_t length = utf8_decode(text.data() + i, text.size() - i, cp);
+        char bytes[4];
+        if (cp != UTF8_INVALID) utf8_encode(classes.to_lower(cp), bytes);
+        for (size_t j = 0; j < length; j++) {
+            word_byte[i + j] = classes.is_word(cp);
+            if (cp != UTF8_INVALID) lowered[i + j] = bytes[j];
+        }
+        i += length;
+    }
+
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && is_space_byte(text[i])) i++;
+        size_t start = i;
+        while (i < text.size() && !is_space_byte(text[i])) i++;
+        if (i == start) continue;
+
+        // The erasures of abbreviate(), applied to the offsets of the bytes as well
+        std::string word = text.substr(start, i - start);
+        std::vector<size_t> at (word.size());
+        for (size_t j = 0; j < at.size(); j++) at[j] = start + j;
+        bool ab = false;
+        for (size_t curr = 0; curr < word.size(); curr++) {
+            if (word[curr] == '.' && curr + 2 < word.size() && word[curr + 2] == '.') ab = true;
+            else if (ab) ab = false;
+            else continue;
+            word.erase(word.begin() + curr);
+            at.erase(at.begin() + curr);
+        }
+
+        std::string token;
+        for (size_t j : at) {
+            if (word_byte[j]) token += lowercase ? lowered[j] : text[j];
+            else if (!token.empty()) {
+                tokens.push_back(token);
+                token.clear();
+            }
+        }
+        if (!token.empty()) tokens.push_back(token);
+    }
+    return tokens;
+}
+
+inline bool hasVowel(std::string s, int n) {
+    for (int i = 0; i < s.length() - n; i++) if (ORIGINAL_VOWELS.count(s[i])) return true;
+    return false;
+}
+
+inline std::string adjustWord(std::string s) {
+    if (s.length() < 2 || !hasVowel(s, 0)) return s;
+    std::string foo = s.substr(s.length() - 2);
+    if (foo == "at" || foo == "bl" || foo == "iz") {
+        s.append("e");
+        return s;
+    }
+
+    std::set<std::string> invalidDoubles = {"ll", "ss", "zz"};
+    if (foo[0] == foo[1] && !invalidDoubles.count(foo)) {
+        return s.substr(0, s.length() - 1);
+    } else if (s.length() < 4) {
+        s.append("e");
+        return s;
+    }
+    return s;
+}
+
+inline std::string porterStem(std::string word) {
+    // Step 1a
+    int l = word.length();
+    if (l > 4 && word.substr(l - 4) == "sses") {
+        word = word.substr(0, l - 2);
+    } else if (l > 3) {
+        if (word.substr(l - 3) == "ies" || word.substr(l - 3) == "ied") {
+            if (l > 4) word = word.substr(0, l - 2);
+            else word = word.substr(0, l - 1);
+        } else if (l > 2 && word[l - 1] == 's' && hasVowel(word, 2)) {
+            word = word.substr(0, l - 1);
+        }
+    } else if (l < 2 || word.substr(l - 2) == "us" || word.substr(l - 2) == "ss") {
+        // Do nothing
+    } else if (l > 2 && word[l - 1] == 's' && hasVowel(word, 2)) {
+        word = word.substr(0, l - 1);
+    }
+
+    // Step 1b
+    l = word.length();
+    if (l > 7 && word.substr(l - 5) == "eedly" && ORIGINAL_VOWELS.count(word[l - 7]) && !ORIGINAL_VOWELS.count(word[l - 6])) {
+        word = word.substr(0, l - 3);
+    } else if (l > 5 && word.substr(l - 3) == "eed" && ORIGINAL_VOWELS.count(word[l - 5]) && !ORIGINAL_VOWELS.count(word[l - 4])) {
+        word = word.substr(0, l - 1);
+    } else if (l > 5 && word.substr(l - 5) == "ingly") {
+        word = adjustWord(word.substr(0,l - 5));
+    } else if (l > 4 && word.substr(l - 4) == "edly") {
+        word = adjustWord(word.substr(0,l - 4));
+    } else if (l > 3 && word.substr(l - 3) == "ing") {
+        word = adjustWord(word.substr(0,l - 3));
+    } else if (l > 2 && word.substr(l - 2) == "ed") {
+        word = adjustWord(word.substr(0, l - 2));
+    }
+    return word;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Bounded lock-free queue for one producer thread and one consumer thread.
+ * A power-of-two ring of slots with a head index written only by the consumer and a tail index
+ * written only by the producer, each on its own cache line. Each side caches the other's index
+ * and rereads it only when the ring looks full (or empty). The blocking push() and pop() spin with
+ * yield and add up the time they waited, and the producer samples the depth on every push.
+ */
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <class T>
+class SpscQueue {
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head {0};   // Next slot to pop
+    size_t cached_tail = 0;
+    double pop_wait = 0;
+
+    alignas(64) std::atomic<size_t> tail {0};   // Next slot to push
+    size_t cached_head = 0;
+    double push_wait = 0;
+    size_t pushes = 0;
+    size_t depth_sum = 0;
+    size_t depth_max = 0;
+
+    public:
+        // Rounds capacity up to a power of two
+        explicit SpscQueue(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity) size *= 2;
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // Producer only: adds item unless the queue is full
+        bool try_push(T& item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - cached_head == slots.size()) {
+                cached_head = head.load(std::memory_order_acquire);
+                if (t - cached_head == slots.size()) return false;
+            }
+            slots[t & mask] = std::move(item);
+            tail.store(t + 1, std::memory_order_release);
+
+            size_t depth = t + 1 - cached_head;
+            pushes++;
+            depth_sum += depth;
+            if (depth > depth_max) depth_max = depth;
+            return true;
+        }
+
+        // Consumer only: takes the oldest item unless the queue is empty
+        bool try_pop(T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == cached_tail) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (h == cached_tail) return false;
+            }
+            item = std::move(slots[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Producer only: adds item, waiting while the queue is full
+        void push(T item) {
+            if (try_push(item)) return;
+            auto start = std::chrono::steady_clock::now();
+            while (!try_push(item)) std::this_thread::yield();
+            push_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Consumer only: takes the oldest item, waiting while the queue is empty
+        T pop() {
+            T item;
+            if (try_pop(item)) return item;
+            auto start = std::chrono::steady_clock::now();
+            while (!try_pop(item)) std::this_thread::yield();
+            pop_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return item;
+        }
+
+        // Seconds the producer waited on a full queue and the consumer on an empty one. Read once
+        // both threads are done.
+        double producer_wait() const { return push_wait; }
+        double consumer_wait() const { return pop_wait; }
+
+        // Items in the queue right after each push, on average and at most
+        double average_depth() const { return pushes == 0 ? 0 : (double) depth_sum / pushes; }
+        size_t max_depth() const { return depth_max; }
+
+        size_t capacity() const { return slots.size(); }
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Memoizing front-end for PorterStemmer.
+ * Token frequencies are Zipfian, so a small cache of surface form -> stem answers almost every
+ * lookup after warm-up. The table is 4-way set-associative with CLOCK (second chance) replacement
+ * inside each set, sized to stay under a fixed memory budget. A lookup reads the set's tags and
+ * then at most one entry.
+ */
+
+#ifndef STEM_CACHE_HPP
+#define STEM_CACHE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "../common/hash.hpp"
+#include "../common/stemmer.hpp"
+
+// Longest surface form that is cached, longer words are always stemmed directly
+const size_t STEM_CACHE_MAX_WORD = 30;
+const size_t STEM_CACHE_WAYS = 4;
+
+// Tags and CLOCK state of one set, two sets per cache line
+struct StemCacheSet {
+    uint32_t tags[STEM_CACHE_WAYS];         // Upper hash bits, 0 marks an empty way
+    uint8_t referenced[STEM_CACHE_WAYS];    // CLOCK bits, set on every hit
+    uint8_t hand;
+    uint8_t unused[11];
+};
+static_assert(sizeof(StemCacheSet) == 32, "two StemCacheSets should share a cache line");
+
+// The stemmer only truncates the word and may then write one 'e', so the stem is stored as a prefix
+// length of the surface form plus a flag
+struct StemCacheEntry {
+    uint8_t length;
+    uint8_t stem_length;                    // Top bit set if the stem ends in an added 'e'
+    char surface[STEM_CACHE_MAX_WORD];
+};
+static_assert(sizeof(StemCacheEntry) == 32, "StemCacheEntry should be half a cache line");
+
+class StemCache {
+    PorterStemmer stemmer;
+    std::vector<StemCacheSet> sets;
+    std::vector<StemCacheEntry> entries;
+    size_t set_mask = 0;
+    char result[STEM_CACHE_MAX_WORD];
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    size_t eviction_count = 0;
+
+    public:
+        // Uses the largest power-of-two number of sets that fits in memory_budget bytes, or no cache at all
+        explicit StemCache(size_t memory_budget) {
+            size_t set_bytes = sizeof(StemCacheSet) + STEM_CACHE_WAYS * sizeof(StemCacheEntry);
+            if (set_bytes > memory_budget) return;
+            size_t set_count = 1;
+            while (set_count * 2 * set_bytes <= memory_budget) set_count *= 2;
+            sets.assign(set_count, StemCacheSet());
+            entries.assign(set_count * STEM_CACHE_WAYS, StemCacheEntry());
+            set_mask = set_count - 1;
+        }
+
+        // Returns the stem of word, valid until the next call
+        std::string_view stem(std::string_view word) {
+            if (sets.empty() || word.size() > STEM_CACHE_MAX_WORD) {
+                miss_count++;
+                return stemmer.stem(word);
+            }
+            uint64_t h = hash_bytes(word.data(), word.size());
+            uint32_t tag = (uint32_t) (h >> 32) | 1;
+            StemCacheSet& set = sets[h & set_mask];
+            StemCacheEntry* ways = &entries[(h & set_mask) * STEM_CACHE_WAYS];
+
+            for (size_t i = 0; i < STEM_CACHE_WAYS; i++) {
+                if (set.tags[i] != tag) continue;
+                StemCacheEntry& e = ways[i];
+                if (e.length == word.size() && memcmp(e.surface, word.data(), word.size()) == 0) {
+                    hit_count++;
+                    set.referenced[i] = 1;
+                    size_t prefix = e.stem_length & 0x7f;
+                    if (!(e.stem_length & 0x80)) return std::string_view(e.surface, prefix);
+                    memcpy(result, e.surface, prefix);
+                    result[prefix] = 'e';
+                    return std::string_view(result, prefix + 1);
+                }
+            }
+            miss_count++;
+
+            // Take an empty way, otherwise sweep the hand past recently used entries
+            size_t victim = STEM_CACHE_WAYS;
+            for (size_t i = 0; i < STEM_CACHE_WAYS && victim == STEM_CACHE_WAYS; i++) if (set.tags[i] == 0) victim = i;
+            if (victim == STEM_CACHE_WAYS) {
+                while (set.referenced[set.hand]) {
+                    set.referenced[set.hand] = 0;
+                    set.hand = (set.hand + 1) % STEM_CACHE_WAYS;
+                }
+                victim = set.hand;
+                set.hand = (set.hand + 1) % STEM_CACHE_WAYS;
+                eviction_count++;
+            }
+
+            std::string_view stemmed = stemmer.stem(word);
+            size_t prefix = stemmed.size();
+            bool added_e = prefix > 0 && (prefix > word.size() || word[prefix - 1] != 'e') && stemmed[prefix - 1] == 'e';
+            if (added_e) prefix--;
+            StemCacheEntry& e = ways[victim];
+            set.tags[victim] = tag;
+            set.referenced[victim] = 0;
+            e.length = (uint8_t) word.size();
+            e.stem_length = (uint8_t) (prefix | (added_e ? 0x80 : 0));
+            memcpy(e.surface, word.data(), word.size());
+            return stemmed;
+        }
+
+        // Returns the number of lookups answered from the cache
+        size_t hits() const { return hit_count; }
+
+        // Returns the number of lookups that ran the stemmer
+        size_t misses() const { return miss_count; }
+
+        // Returns the number of entries replaced to make room
+        size_t evictions() const { return eviction_count; }
+
+        // Returns the number of cached surface forms the table can hold
+        size_t capacity() const { return entries.size(); }
+
+        // Returns the bytes held by the table
+        size_t memory() const { return sets.size() * sizeof(StemCacheSet) + entries.size() * sizeof(StemCacheEntry); }
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Interned term dictionary.
+ * Term bytes live back to back in one arena and every distinct term gets a dense id, in order of
+ * first appearance. Frequencies are a flat array indexed by id, and an open-addressing table of
+ * ids (linear probing, keyed by string_view) finds the id of a term. Each term costs its bytes plus
+ * an offset, a count and about 1.5 table slots, roughly 12-14 bytes.
+ */
+
+#ifndef TERM_DICTIONARY_HPP
+#define TERM_DICTIONARY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "../common/hash.hpp"
+#include "../common/inline_term.hpp"
+
+class TermDictionary {
+    std::vector<char> arena;
+    std::vector<uint32_t> offsets = {0};    // Term id starts at offsets[id] and ends at offsets[id + 1]
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> slots;            // id + 1, 0 marks an empty slot
+    size_t slot_mask = 0;
+
+    // Returns the slot holding term, or the empty slot where it belongs
+    size_t findSlot(std::string_view term, uint64_t h) const {
+        size_t slot = h & slot_mask;
+        while (slots[slot] != 0) {
+            uint32_t id = slots[slot] - 1;
+            if (offsets[id + 1] - offsets[id] == term.size() && memcmp(&arena[offsets[id]], term.data(), term.size()) == 0) break;
+            slot = (slot + 1) & slot_mask;
+        }
+        return slot;
+    }
+
+    // Doubles the table and reinserts every id
+    void grow() {
+        std::vector<uint32_t> old_slots;
+        old_slots.swap(slots);
+        slots.assign(old_slots.empty() ? 1024 : old_slots.size() * 2, 0);
+        slot_mask = slots.size() - 1;
+        for (uint32_t entry : old_slots) {
+            if (entry == 0) continue;
+            std::string_view term = this->term(entry - 1);
+            slots[findSlot(term, hash_bytes(term.data(), term.size()))] = entry;
+        }
+    }
+
+    public:
+        // Returns the id of term, adding it with a count of 0 if it is new. h is the term's
+        // hash_bytes() hash, when the caller already has it.
+        uint32_t intern(std::string_view term, uint64_t h) {
+            // Keep the load factor at or below 3/4
+            if ((counts.size() + 1) * 4 > slots.size() * 3) grow();
+            size_t slot = findSlot(term, h);
+            if (slots[slot] != 0) return slots[slot] - 1;
+
+            uint32_t id = (uint32_t) counts.size();
+            arena.insert(arena.end(), term.begin(), term.end());
+            offsets.push_back((uint32_t) arena.size());
+            counts.push_back(0);
+            slots[slot] = id + 1;
+            return id;
+        }
+
+        uint32_t intern(std::string_view term) { return intern(term, hash_bytes(term.data(), term.size())); }
+
+        // Counts one occurrence of term and returns its id
+        uint32_t add(std::string_view term, uint64_t h) {
+            uint32_t id = intern(term, h);
+            counts[id]++;
+            return id;
+        }
+
+        uint32_t add(std::string_view term) { return add(term, hash_bytes(term.data(), term.size())); }
+
+        uint32_t add(const InlineTerm& term) { return add(term.view(), term.hash()); }
+
+        // Returns the term with the given id
+        std::string_view term(uint32_t id) const { return std::string_view(&arena[offsets[id]], offsets[id + 1] - offsets[id]); }
+
+        // Returns the frequency of the term with the given id
+        uint32_t& count(uint32_t id) { return counts[id]; }
+        uint32_t count(uint32_t id) const { return counts[id]; }
+
+        // Returns the number of distinct terms
+        size_t size() const { return counts.size(); }
+
+        // Returns the bytes held by the dictionary
+        size_t memory() const {
+            return arena.capacity() + offsets.capacity() * sizeof(uint32_t) + counts.capacity() * sizeof(uint32_t)
+                   + slots.capacity() * sizeof(uint32_t);
+        }
+};
+
+#endif
@@ -1,194 +1,1183 @@
+/*
+ * Build: g++ -std=c++17 -O2 -march=native -pthread tokenizer.cpp -o Tokenization -lz && ./Tokenization -check-stopwords stopwords.txt
+ */
+
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <set>
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <string_view>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <random>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <cstring>
+#include <glob.h>
+#include "../common/analyzer.hpp"
+#include "../common/gzip_reader.hpp"
+#include "../common/inline_term.hpp"
+#include "../common/mapped_file.hpp"
+#include "../common/stemmer.hpp"
+#include "../common/stopword_table.hpp"
+#include "reference_tokenizer.hpp"
+#include "stem_cache.hpp"
+#include "heavy_hitters.hpp"
+#include "hyperloglog.hpp"
+#include "ngram_counter.hpp"
+#include "spsc_queue.hpp"
+#include "term_dictionary.hpp"
+#include "vocab_growth.hpp"
+#include "work_stealing.hpp"
 
 using namespace std;
 
-set<string> stopwords;
-set<char> vowels = {'a', 'e', 'i', 'o', 'u'};
-vector<string> input;
-unordered_map<string, int> token_counter;
-vector<pair<string, int>> token_freq;
+PerfectHashView stopwords;
+PerfectHashSet<DynamicHashStorage> loaded_stopwords;
+TermDictionary token_counter;
+vector<uint32_t> token_freq;
 
-void getStopwords(const char* filename) {
+// Reads the stopword list, one word per line
+vector<string> readStopwords(const char* filename) {
     ifstream stopwords_stream (filename);
+    if (!stopwords_stream.is_open()) {
+        cout << "stopword file could not be opened" << endl;
+        exit(-1);
+    }
+    vector<string> words;
     string word;
-    while(getline(stopwords_stream, word, '\n')) stopwords.insert(word);
+    while(getline(stopwords_stream, word, '\n')) words.push_back(word);
     stopwords_stream.close();
+    return words;
 }
 
-void getInput(const char* filename) {
-    ifstream input_stream (filename);
-    string word;
-    while(getline(input_stream, word, ' ')) input.push_back(word);
-    input_stream.close();
+// Points stopwords at a perfect-hash table: "builtin" selects the list compiled in from
+// stopwords.txt, any other name is loaded into a table with the same layout
+void getStopwords(const char* filename) {
+    if (string(filename) == "builtin") {
+        stopwords = BUILTIN_STOPWORD_TABLE.view();
+        return;
+    }
+    vector<string> words = readStopwords(filename);
+    vector<string_view> views (words.begin(), words.end());
+    if (!loaded_stopwords.build(views.data(), views.size())) {
+        cout << "could not build a perfect hash for the stopword list" << endl;
+        exit(-1);
+    }
+    stopwords = loaded_stopwords.view();
+}
+
+// Compares the list compiled into common/stopwords_list.hpp with a stopword file, word by word,
+// and prints how to regenerate the header if they differ. Returns the number of differing lines.
+int checkStopwords(const char* filename) {
+    vector<string> words = readStopwords(filename);
+    size_t builtin = size(BUILTIN_STOPWORDS);
+    int differences = 0;
+    for (size_t i = 0; i < std::max(words.size(), builtin); i++) {
+        string_view expected = i < words.size() ? string_view(words[i]) : "(none)";
+        string_view actual = i < builtin ? BUILTIN_STOPWORDS[i] : "(none)";
+        if (expected == actual) continue;
+        if (differences++ < 10) cout << "line " << i + 1 << ": " << filename << " has '" << expected << "', the builtin list '" << actual << "'" << endl;
+    }
+    if (differences > 0) {
+        cout << differences << " lines differ, regenerate common/stopwords_list.hpp with the command at its top" << endl;
+    }
+    return differences;
+}
+
+// Orders term ids by frequency, ties by term, so the output does not depend on hash order
+struct FrequencyOrder {
+    const TermDictionary& terms;
+
+    bool operator()(uint32_t a, uint32_t b) const {
+        return terms.count(a) > terms.count(b) || (terms.count(a) == terms.count(b) && terms.term(a) < terms.term(b));
+    }
+};
+
+// Ranks the k most frequent ids first; the rest of token_freq is left unordered
+void mapSort(const TermDictionary& terms, size_t k) {
+    // Every id, ranked over the flat frequency array
+    token_freq.resize(terms.size());
+    for (uint32_t id = 0; id < terms.size(); id++) token_freq[id] = id;
+
+    // Only the top k need an order
+    k = std::min(k, token_freq.size());
+    partial_sort(token_freq.begin(), token_freq.begin() + k, token_freq.end(), FrequencyOrder{terms});
+}
+
+int min(int a, int b) {
+    if (a < b) return a;
+    return b;
 }
 
-string abbreviate(string& s) {
-    bool ab = false;
-    int curr = 0;
-    while (curr < s.length()) {
-        if (s[curr] == '.' && s[curr + 2] == '.') {
-            s.erase(s.begin() + curr);
-            ab = true;
-        } else if (ab) {
-            s.erase(s.begin() + curr);
-            ab = false;
+// What countChunk() collects besides the exact counts
+struct CountOptions {
+    bool use_simd = true;
+    size_t stem_cache_bytes = 0;
+    size_t top_k_bytes = 0;     // Space-Saving budget, 0 counts every term exactly
+    int hll_precision = 0;      // HyperLogLog precision for the vocabulary estimate, 0 for none
+};
+
+// A token that raised a HyperLogLog register, by its index among the counted tokens
+struct RegisterRaise {
+    long long token;
+    uint32_t index;
+    uint8_t rank;
+};
+
+// Term statistics of one chunk of the input
+struct ChunkCounts {
+    TermDictionary terms;
+    SpaceSaving heavy_hitters;  // Replaces terms and first when counting with bounded memory
+    vector<long long> first;    // Index of each term's first occurrence among the chunk's counted tokens
+    HyperLogLog vocabulary = HyperLogLog(HLL_MIN_PRECISION);
+    vector<RegisterRaise> raises;
+    long long tokens = 0;
+    size_t stem_hits = 0;
+    size_t stem_misses = 0;
+    size_t stem_evictions = 0;
+};
+
+// Splits text into at most n chunks that start and end at whitespace, so no word is cut
+vector<string_view> splitAtWhitespace(string_view text, int n) {
+    vector<string_view> chunks;
+    size_t start = 0;
+    for (int i = 1; i <= n && start < text.size(); i++) {
+        size_t end = i == n ? text.size() : std::max(start, text.size() / n * i);
+        while (end < text.size() && !is_space_byte(text[end])) end++;
+        chunks.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+// Tokenizes, filters, stems and counts one chunk
+void countChunk(string_view chunk, const CountOptions& options, ChunkCounts& counts) {
+    // Tokens come out lowercased, without stopwords and stemmed
+    Analyzer<true, true, PerfectHashView, StemCache> analyzer (chunk, stopwords, StemCache(options.stem_cache_bytes), options.use_simd);
+    counts.heavy_hitters = SpaceSaving(options.top_k_bytes);
+    if (options.hll_precision > 0) counts.vocabulary = HyperLogLog(options.hll_precision);
+    Token token;
+    while (analyzer.next(token)) {
+        // The term is hashed once here, every table below reuses the hash
+        InlineTerm term (token.term);
+        uint64_t h = term.hash();
+        // Counting; ids are handed out in order, so a new id is a new term
+        if (options.top_k_bytes > 0) counts.heavy_hitters.add(term);
+        else {
+            uint32_t id = counts.terms.add(term);
+            if (id == counts.first.size()) counts.first.push_back(counts.tokens);
+        }
+        // Every register raise is kept, so the vocabulary curve can be replayed across chunks
+        if (options.hll_precision > 0) {
+            if (counts.vocabulary.add_hash(h)) {
+                counts.raises.push_back(RegisterRaise{counts.tokens, (uint32_t) counts.vocabulary.index(h), counts.vocabulary.rank(h)});
+            }
         }
-        curr++;
+        // Increment collection size
+        counts.tokens++;
     }
-    return s;
+    counts.stem_hits = analyzer.stemming().hits();
+    counts.stem_misses = analyzer.stemming().misses();
+    counts.stem_evictions = analyzer.stemming().evictions();
 }
 
-string removePunc(string s) {
-    for (int i = 0; i < s.length(); i++) {
-        if (!isalnum(s[i])) {
-            if (i + 1 < s.length()) input.push_back(s.substr(i + 1));
-            s = s.substr(0, i);
-            i--;
+// Statistics of the whole collection, merged from the chunks in text order
+struct CollectionCounts {
+    vector<long long> first_occurrences;    // Sorted, a term is interned at its first occurrence
+    long long collection_size = 0;
+    size_t stem_hits = 0;
+    size_t stem_misses = 0;
+    size_t stem_evictions = 0;
+    SpaceSaving heavy_hitters;
+    HyperLogLog vocabulary = HyperLogLog(HLL_MIN_PRECISION);
+    vector<RegisterRaise> raises;
+};
+
+// Merges the next chunk in text order into token_counter and collection, offsetting first
+// occurrences by the tokens of everything before it, and empties it
+void mergeChunk(ChunkCounts& counts, CollectionCounts& collection) {
+    collection.heavy_hitters.merge(counts.heavy_hitters);
+    collection.vocabulary.merge(counts.vocabulary);
+    for (RegisterRaise raise : counts.raises) {
+        raise.token += collection.collection_size;
+        collection.raises.push_back(raise);
+    }
+    for (uint32_t id = 0; id < counts.terms.size(); id++) {
+        uint32_t global_id = token_counter.intern(counts.terms.term(id));
+        token_counter.count(global_id) += counts.terms.count(id);
+        if (global_id == collection.first_occurrences.size()) {
+            collection.first_occurrences.push_back(collection.collection_size + counts.first[id]);
         }
     }
-    return s;
+    collection.collection_size += counts.tokens;
+    collection.stem_hits += counts.stem_hits;
+    collection.stem_misses += counts.stem_misses;
+    collection.stem_evictions += counts.stem_evictions;
+    counts = ChunkCounts();
 }
 
-bool hasVowel(string s, int n) {
-    for (int i = 0; i < s.length() - n; i++) if (vowels.count(s[i])) return true;
-    return false;
+// Counts text on up to threads threads and merges it into collection, returns the number of chunks
+size_t countText(string_view text, int threads, const CountOptions& options, CollectionCounts& collection) {
+    vector<string_view> chunks = splitAtWhitespace(text, threads);
+    vector<ChunkCounts> chunk_counts (chunks.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        workers.emplace_back(countChunk, chunks[i], std::cref(options), std::ref(chunk_counts[i]));
+    }
+    for (thread& worker : workers) worker.join();
+    for (ChunkCounts& counts : chunk_counts) mergeChunk(counts, collection);
+    return chunks.size();
+}
+
+// Compressed input is counted in pieces of PIECE_BYTES, inflated in blocks of INFLATE_BLOCK
+const size_t PIECE_BYTES = 16 << 20;
+const size_t INFLATE_BLOCK = 1 << 20;
+
+// Reads a compressed file a piece of about piece_bytes at a time as it is inflated and calls
+// consume(string_view) on each. Pieces end at whitespace, so no word is split and the counts match
+// those of the uncompressed text. Returns the number of uncompressed bytes, or -1 if the data could
+// not be read completely.
+template <class Consume>
+long long forEachPiece(GzipReader& reader, size_t piece_bytes, Consume consume) {
+    string piece;
+    size_t carry = 0;
+    long long total = 0;
+    while (true) {
+        piece.resize(carry + piece_bytes);
+        size_t got = reader.read(&piece[carry], piece_bytes);
+        size_t length = carry + got;
+        total += got;
+        bool last = got < piece_bytes;
+
+        // Hold back the word running off the end of the piece, unless the piece is one huge word
+        size_t cut = length;
+        if (!last) {
+            while (cut > 0 && !is_space_byte(piece[cut - 1])) cut--;
+            if (cut == 0) cut = length;
+        }
+        if (cut > 0) consume(string_view(piece.data(), cut));
+        carry = length - cut;
+        memmove(&piece[0], &piece[cut], carry);
+        if (last) break;
+    }
+    return reader.failed() ? -1 : total;
 }
 
-string adjustWord(string s) {
-    if (!hasVowel(s, 0)) return s;
-    string foo = s.substr(s.length() - 2);
-    if (foo == "at" || foo == "bl" || foo == "iz") {
-        s.append("e");
-        return s;
+// Pipeline mode: a read stage cuts the input into blocks, tokenize stages turn each block into a
+// batch of term ids, and a count stage folds the batches into token_counter in input order. Stages
+// run on their own threads and hand work over through bounded single-producer queues.
+const size_t PIPELINE_BLOCK = 1 << 20;
+const size_t PIPELINE_QUEUE = 8;
+
+// A block of input, a view into the mapped file or into owned inflated text. An empty last block
+// ends the stream.
+struct PipelineBlock {
+    string owned;
+    string_view text;
+    bool last = false;
+};
+
+// The terms of one block as ids of the tokenize stage's own dictionary. Terms that stage had not
+// seen before are appended to new_terms in id order, so the count stage can map them once.
+struct TermBatch {
+    vector<uint32_t> ids;
+    string new_terms;
+    vector<uint32_t> new_term_ends;
+    bool last = false;
+};
+
+// Lets every block's Analyzer share one stage's stem cache
+struct SharedStemCache {
+    StemCache* cache;
+    string_view stem(string_view word) { return cache->stem(word); }
+};
+
+// Seconds from the start of the run to when each stage thread finished, and how long each waited
+struct PipelineStats {
+    int workers = 0;
+    double seconds = 0;
+    double read_seconds = 0;
+    double read_wait = 0;
+    vector<double> tokenize_seconds;
+    vector<double> tokenize_wait;
+    double count_seconds = 0;
+    double count_wait = 0;
+    double block_depth = 0;     // Average and largest depth over the queues feeding a stage
+    size_t block_depth_max = 0;
+    double batch_depth = 0;
+    size_t batch_depth_max = 0;
+    size_t queue_capacity = 0;
+};
+
+// Read stage: deals blocks that end at whitespace round-robin to the tokenize stages, then ends
+// every stream. Plain files are sliced without copying. Returns the input bytes, or -1 on failure.
+long long readStage(string_view mapped, GzipReader* reader, vector<unique_ptr<SpscQueue<PipelineBlock>>>& blocks) {
+    size_t next = 0;
+    auto send = [&](PipelineBlock block) {
+        blocks[next]->push(std::move(block));
+        next = (next + 1) % blocks.size();
+    };
+    long long total;
+    if (reader) {
+        total = forEachPiece(*reader, PIPELINE_BLOCK, [&](string_view piece) {
+            PipelineBlock block;
+            block.owned.assign(piece.data(), piece.size());
+            block.text = block.owned;
+            send(std::move(block));
+        });
+    }
+    else {
+        total = (long long) mapped.size();
+        size_t start = 0;
+        while (start < mapped.size()) {
+            size_t end = std::min(mapped.size(), start + PIPELINE_BLOCK);
+            while (end < mapped.size() && !is_space_byte(mapped[end])) end++;
+            PipelineBlock block;
+            block.text = mapped.substr(start, end - start);
+            send(std::move(block));
+            start = end;
+        }
+    }
+    for (auto& queue : blocks) {
+        PipelineBlock block;
+        block.last = true;
+        queue->push(std::move(block));
     }
+    return total;
+}
 
-    set<string> invalidDoubles = {"ll", "ss", "zz"};
-    if (foo[0] == foo[1] && !invalidDoubles.count(foo)) {
-        return s.substr(0, s.length() - 1);
-    } else if (s.length() < 4) {
-        s.append("e");
-        return s;
+// Tokenize stage: analyzes each block and sends its terms as ids of a dictionary private to the stage
+void tokenizeStage(SpscQueue<PipelineBlock>& blocks, SpscQueue<TermBatch>& batches, const CountOptions& options, ChunkCounts& counts) {
+    StemCache cache (options.stem_cache_bytes);
+    while (true) {
+        PipelineBlock block = blocks.pop();
+        TermBatch batch;
+        batch.last = block.last;
+        if (!block.last) {
+            Analyzer<true, true, PerfectHashView, SharedStemCache> analyzer (block.text, stopwords, SharedStemCache{&cache}, options.use_simd);
+            Token token;
+            while (analyzer.next(token)) {
+                uint32_t known = counts.terms.size();
+                uint32_t id = counts.terms.intern(token.term);
+                if (id == known) {
+                    batch.new_terms.append(token.term);
+                    batch.new_term_ends.push_back((uint32_t) batch.new_terms.size());
+                }
+                batch.ids.push_back(id);
+            }
+        }
+        batches.push(std::move(batch));
+        if (block.last) break;
     }
-    return s;
+    counts.stem_hits = cache.hits();
+    counts.stem_misses = cache.misses();
+    counts.stem_evictions = cache.evictions();
 }
 
-string porterStem(string word) {
-    // Step 1a
-    int l = word.length();
-    if (l > 4 && word.substr(l - 4) == "sses") {
-        word = word.substr(0, l - 2);
-    } else if (l > 3) {
-        if (word.substr(l - 3) == "ies" || word.substr(l - 3) == "ied") {
-            if (l > 4) word = word.substr(0, l - 2);
-            else word = word.substr(0, l - 1);
-        } else if (l > 2 && word[l - 1] == 's' && hasVowel(word, 2)) {
-            word = word.substr(0, l - 1);
+// Counts the input with one read stage, workers tokenize stages and a count stage on the calling
+// thread. Blocks go round-robin, so batches are taken in the same order and the counts, first
+// occurrences included, match the sequential ones. Returns the input bytes, or -1 on failure.
+long long countPipelined(string_view mapped, GzipReader* reader, int workers, const CountOptions& options,
+                         CollectionCounts& collection, PipelineStats& stats) {
+    auto start_time = chrono::steady_clock::now();
+    vector<unique_ptr<SpscQueue<PipelineBlock>>> blocks;
+    vector<unique_ptr<SpscQueue<TermBatch>>> batches;
+    vector<ChunkCounts> worker_counts (workers);
+    for (int i = 0; i < workers; i++) {
+        blocks.push_back(make_unique<SpscQueue<PipelineBlock>>(PIPELINE_QUEUE));
+        batches.push_back(make_unique<SpscQueue<TermBatch>>(PIPELINE_QUEUE));
+    }
+    auto elapsed = [&] { return chrono::duration<double>(chrono::steady_clock::now() - start_time).count(); };
+    long long total = 0;
+    thread reader_thread ([&] {
+        total = readStage(mapped, reader, blocks);
+        stats.read_seconds = elapsed();
+    });
+    vector<thread> tokenizers;
+    stats.tokenize_seconds.assign(workers, 0);
+    for (int i = 0; i < workers; i++) {
+        tokenizers.emplace_back([&, i] {
+            tokenizeStage(*blocks[i], *batches[i], options, worker_counts[i]);
+            stats.tokenize_seconds[i] = elapsed();
+        });
+    }
+
+    // Count stage: map each worker's ids to global ids the first time they appear
+    vector<vector<uint32_t>> global_ids (workers);
+    for (size_t seq = 0;; seq++) {
+        TermBatch batch = batches[seq % workers]->pop();
+        if (batch.last) break;
+        vector<uint32_t>& to_global = global_ids[seq % workers];
+        uint32_t begin = 0;
+        for (uint32_t end : batch.new_term_ends) {
+            to_global.push_back(token_counter.intern(string_view(batch.new_terms).substr(begin, end - begin)));
+            begin = end;
+        }
+        for (uint32_t id : batch.ids) {
+            if (token_counter.count(to_global[id])++ == 0) collection.first_occurrences.push_back(collection.collection_size);
+            collection.collection_size++;
         }
-    } else if (word.substr(l - 2) == "us" || word.substr(l - 2) == "ss") {
-        // Do nothing
-    } else if (l > 2 && word[l - 1] == 's' && hasVowel(word, 2)) {
-        word = word.substr(0, l - 1);
     }
+    stats.count_seconds = elapsed();
+    reader_thread.join();
+    for (thread& tokenizer : tokenizers) tokenizer.join();
 
-    // Step 1b
-    l = word.length();
-    if (l > 7 && word.substr(l - 5) == "eedly" && vowels.count(word[l - 7]) && !vowels.count(word[l - 6])) {
-        word = word.substr(0, l - 3);
-    } else if (l > 5 && word.substr(l - 3) == "eed" && vowels.count(word[l - 5]) && !vowels.count(word[l - 4])) {
-        word = word.substr(0, l - 1);
-    } else if (l > 5 && word.substr(l - 5) == "ingly") {
-        word = adjustWord(word.substr(0,l - 5));
-    } else if (l > 4 && word.substr(l - 4) == "edly") {
-        word = adjustWord(word.substr(0,l - 4));
-    } else if (l > 3 && word.substr(l - 3) == "ing") {
-        word = adjustWord(word.substr(0,l - 3));
-    } else if (l > 2 && word.substr(l - 2) == "ed") {
-        word = adjustWord(word.substr(0, l - 2));
+    stats.workers = workers;
+    stats.seconds = elapsed();
+    stats.queue_capacity = blocks[0]->capacity();
+    for (int i = 0; i < workers; i++) {
+        collection.stem_hits += worker_counts[i].stem_hits;
+        collection.stem_misses += worker_counts[i].stem_misses;
+        collection.stem_evictions += worker_counts[i].stem_evictions;
+        stats.read_wait += blocks[i]->producer_wait();
+        stats.tokenize_wait.push_back(blocks[i]->consumer_wait() + batches[i]->producer_wait());
+        stats.count_wait += batches[i]->consumer_wait();
+        stats.block_depth += blocks[i]->average_depth() / workers;
+        stats.block_depth_max = std::max(stats.block_depth_max, blocks[i]->max_depth());
+        stats.batch_depth += batches[i]->average_depth() / workers;
+        stats.batch_depth_max = std::max(stats.batch_depth_max, batches[i]->max_depth());
     }
-    return word;
+    return total;
 }
 
-bool cmp(pair<string, int> a, pair<string, int> b) {
-    return a.second > b.second;
+// Prints how busy each stage was and how full the queues ran. A stage is busy from the start of the
+// run until its thread finishes, except while it waits on a queue; that time is given as a share of
+// the whole run, so a stage that finishes early and then sits idle does not look busy.
+void printPipelineStats(const PipelineStats& stats) {
+    auto busy = [&](double finished, double wait) { return stats.seconds > 0 ? 100 * std::max(0.0, finished - wait) / stats.seconds : 0; };
+    cout << "Pipeline utilization: read " << busy(stats.read_seconds, stats.read_wait) << "%, tokenize";
+    for (int i = 0; i < stats.workers; i++) cout << " " << busy(stats.tokenize_seconds[i], stats.tokenize_wait[i]) << "%";
+    cout << ", count " << busy(stats.count_seconds, stats.count_wait) << "%" << endl;
+    cout << "Queue depth (of " << stats.queue_capacity << "): blocks " << stats.block_depth << " average, " << stats.block_depth_max
+         << " max; batches " << stats.batch_depth << " average, " << stats.batch_depth_max << " max" << endl;
 }
 
-void mapSort(unordered_map<string, int>& map) {
-    // Copy key-value pair from Map to vector of pairs
-    for (auto& it : map) token_freq.push_back(it);
+// Corpus mode: the files of a directory or glob pattern are counted as one collection, in path
+// order. Plain files are cut into tasks of about CORPUS_CHUNK bytes, so a huge file is shared out
+// like many small ones; compressed files are inflated by a single task.
+const size_t CORPUS_CHUNK = 4 << 20;
 
-    // Sort using comparator function
-    sort(token_freq.begin(), token_freq.end(), cmp);
+// Tasks a worker may start ahead of the next one to merge, per worker
+const size_t CORPUS_AHEAD = 4;
+
+// Returns true if name is a directory or a glob pattern rather than a single file
+bool isCorpus(const char* name) {
+    return strpbrk(name, "*?[") != nullptr || filesystem::is_directory(name);
 }
 
-int min(int a, int b) {
-    if (a < b) return a;
-    return b;
+// Lists the regular files below a directory or matching a glob pattern, sorted by path
+vector<string> listCorpus(const char* name) {
+    vector<string> paths;
+    if (filesystem::is_directory(name)) {
+        error_code error;
+        for (auto it = filesystem::recursive_directory_iterator(name, error); !error && it != filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (it->is_regular_file()) paths.push_back(it->path().string());
+        }
+    }
+    else {
+        glob_t matches;
+        if (glob(name, 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                if (filesystem::is_regular_file(matches.gl_pathv[i])) paths.push_back(matches.gl_pathv[i]);
+            }
+        }
+        globfree(&matches);
+    }
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// One file of the corpus and its statistics
+struct CorpusFile {
+    string path;
+    bool compressed = false;
+    unique_ptr<MappedFile> mapped;      // Mapped by the file's first task, unmapped once it is merged
+    TermDictionary file_terms;          // Terms of the chunks merged so far, for files of several chunks
+    long long bytes = 0;                // Uncompressed
+    long long tokens = 0;
+    size_t terms = 0;                   // Distinct terms in the file, 0 with bounded-memory counting
+    size_t new_terms = 0;               // Terms no earlier file had
+    double seconds = 0;                 // Counting time summed over the file's tasks
+    bool failed = false;
+};
+
+// One unit of work: chunk of the chunks a plain file is cut into, or a whole compressed file
+struct CorpusTask {
+    size_t file;
+    size_t chunk;
+    size_t chunks;
+};
+
+// Counts every file on the pool and merges them into collection in path order. Tasks are dealt in
+// path order, each finished task is merged as soon as every task before it has been, and no task
+// starts more than CORPUS_AHEAD tasks per worker past the next one to merge. Only those tasks hold
+// counts and mapped files, however large the corpus. Returns the uncompressed bytes, or -1 if a file
+// could not be read.
+long long countCorpus(const vector<string>& paths, WorkStealingPool& pool, const CountOptions& options,
+                      CollectionCounts& collection, vector<CorpusFile>& files) {
+    files.resize(paths.size());
+    vector<CorpusTask> tasks;
+    for (size_t f = 0; f < paths.size(); f++) {
+        CorpusFile& file = files[f];
+        file.path = paths[f];
+        file.compressed = is_gzip_file(file.path.c_str());
+        error_code error;
+        uintmax_t size = filesystem::file_size(file.path, error);
+        file.bytes = error ? 0 : (long long) size;
+        // A compressed file is inflated by a single task, which replaces its size with the inflated one
+        size_t chunks = file.compressed ? 1 : std::max<size_t>(1, file.bytes / CORPUS_CHUNK);
+        for (size_t c = 0; c < chunks; c++) tasks.push_back(CorpusTask{f, c, chunks});
+    }
+
+    // Workers take their own tasks newest first, so each deque is filled from the last task back
+    for (size_t t = tasks.size(); t-- > 0;) pool.push(t, t);
+
+    vector<once_flag> mapped_once (files.size());
+    vector<unique_ptr<ChunkCounts>> task_counts (tasks.size());
+    vector<double> task_seconds (tasks.size());
+    vector<bool> done (tasks.size());
+    mutex merge_lock;
+    condition_variable merged;
+    bool merging = false;
+    size_t next_merge = 0;
+    size_t file_vocabulary = 0;
+    long long file_tokens = 0;
+    long long total = 0;
+
+    // Merges task t, which every task before it already is, and lets go of its file after its last chunk
+    auto mergeTask = [&](size_t t) {
+        const CorpusTask& task = tasks[t];
+        CorpusFile& file = files[task.file];
+        ChunkCounts& counts = *task_counts[t];
+        if (task.chunk == 0) {
+            file_vocabulary = collection.first_occurrences.size();
+            file_tokens = collection.collection_size;
+        }
+        // A file cut into several chunks needs its own dictionary to count its distinct terms
+        if (task.chunks == 1) file.terms = counts.terms.size();
+        else for (uint32_t id = 0; id < counts.terms.size(); id++) file.file_terms.intern(counts.terms.term(id));
+        file.seconds += task_seconds[t];
+        mergeChunk(counts, collection);
+        task_counts[t].reset();
+        if (task.chunk + 1 < task.chunks) return;
+
+        if (task.chunks > 1) file.terms = file.file_terms.size();
+        file.file_terms = TermDictionary();
+        file.mapped.reset();
+        file.new_terms = collection.first_occurrences.size() - file_vocabulary;
+        file.tokens = collection.collection_size - file_tokens;
+        total += file.bytes;
+    };
+
+    size_t ahead = CORPUS_AHEAD * pool.size();
+    pool.run([&](size_t t, size_t) {
+        {
+            unique_lock<mutex> guard (merge_lock);
+            merged.wait(guard, [&] { return t < next_merge + ahead; });
+        }
+        auto start_time = chrono::steady_clock::now();
+        const CorpusTask& task = tasks[t];
+        CorpusFile& file = files[task.file];
+        auto counts = make_unique<ChunkCounts>();
+        if (file.compressed) {
+            GzipReader reader (file.path.c_str());
+            string text;
+            if (!reader.is_open() || !reader.read_all(text)) file.failed = true;
+            file.bytes = (long long) text.size();
+            countChunk(text, options, *counts);
+        }
+        else {
+            call_once(mapped_once[task.file], [&] { file.mapped = make_unique<MappedFile>(file.path.c_str()); });
+            // Every task of the file cuts it the same way and counts its own chunk; one may be empty
+            // if the text has too little whitespace to cut it into as many
+            if (!file.mapped->is_open()) {
+                if (task.chunk == 0) file.failed = true;
+            }
+            else {
+                vector<string_view> chunks = splitAtWhitespace(file.mapped->view(), (int) task.chunks);
+                if (task.chunk < chunks.size()) countChunk(chunks[task.chunk], options, *counts);
+            }
+        }
+        task_seconds[t] = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+        {
+            lock_guard<mutex> guard (merge_lock);
+            task_counts[t] = std::move(counts);
+            done[t] = true;
+            if (merging) return;
+            merging = true;
+        }
+        // One worker at a time merges whatever is ready, outside the lock so the others can hand in
+        // their counts and go on
+        while (true) {
+            {
+                lock_guard<mutex> guard (merge_lock);
+                if (next_merge == tasks.size() || !done[next_merge]) {
+                    merging = false;
+                    return;
+                }
+            }
+            // Only the merging worker moves next_merge on
+            mergeTask(next_merge);
+            {
+                lock_guard<mutex> guard (merge_lock);
+                next_merge++;
+            }
+            merged.notify_all();
+        }
+    });
+
+    for (const CorpusFile& file : files) {
+        if (file.failed) {
+            cout << file.path << " could not be read completely" << endl;
+            return -1;
+        }
+    }
+    return total;
+}
+
+// Writes one tab-separated line of statistics per file, and prints how the work was shared out
+void writeCorpusStats(const vector<CorpusFile>& files, const WorkStealingPool& pool) {
+    ofstream stats_stream ("file_stats.tsv");
+    stats_stream << "file\tbytes\ttokens\tterms\tnew_terms\tseconds" << endl;
+    for (const CorpusFile& file : files) {
+        stats_stream << file.path << "\t" << file.bytes << "\t" << file.tokens << "\t" << file.terms << "\t" << file.new_terms
+                     << "\t" << file.seconds << endl;
+    }
+    cout << "Corpus: " << files.size() << " files, tasks run (stolen) per worker:";
+    for (size_t w = 0; w < pool.size(); w++) cout << " " << pool.tasks_run(w) << " (" << pool.steals(w) << ")";
+    cout << endl;
+}
+
+// N-gram mode: counts word n-grams (as term ids) or character shingles of the analyzed text
+// instead of single terms, and writes those seen at least min_count times to ngrams.txt
+struct NgramOptions {
+    int words = 0;              // Terms per n-gram, 2-5
+    int shingle = 0;            // Bytes per shingle, 2-8
+    uint64_t min_count = 1;
+    size_t memory_bytes = 256 << 20;
+};
+
+// Feeds the terms of a text, a piece at a time, through rolling windows into an NgramCounter. Word
+// n-grams do not span a removed stopword, so they stay phrases of the original text. Shingles run
+// over the terms joined by single spaces.
+class NgramExtractor {
+    NgramOptions options;
+    bool use_simd;
+    StemCache stem_cache;
+    TermDictionary terms;
+    NgramCounter counter;
+    RollingHash rolling;
+    vector<uint32_t> window;    // Term ids of the current word n-gram, oldest first
+    uint64_t shingle_bytes = 0; // Last shingle bytes, newest in the low byte
+    bool started = false;       // A term has been seen, so the next one follows a space
+    bool gap = false;           // A stopword ended the last piece
+
+    void addSymbol(uint32_t symbol) {
+        rolling.push(symbol);
+        if (options.words > 0) {
+            window.erase(window.begin());
+            window.push_back(symbol);
+            if (rolling.full()) counter.add(rolling.hash(), window.data());
+        }
+        else {
+            uint64_t mask = options.shingle == 8 ? ~(uint64_t) 0 : ((uint64_t) 1 << (8 * options.shingle)) - 1;
+            shingle_bytes = (shingle_bytes << 8 | symbol) & mask;
+            uint32_t packed[2] = {(uint32_t) shingle_bytes, (uint32_t) (shingle_bytes >> 32)};
+            if (rolling.full()) counter.add(rolling.hash(), packed);
+        }
+    }
+
+    public:
+        NgramExtractor(const NgramOptions& options, bool use_simd, size_t stem_cache_bytes)
+            : options(options), use_simd(use_simd), stem_cache(stem_cache_bytes),
+              counter(options.words > 0 ? options.words : 2, options.memory_bytes),
+              rolling(options.words > 0 ? options.words : options.shingle), window(std::max(options.words, 0), 0) {}
+
+        // Counts the n-grams of the next piece of text, which must start at whitespace
+        void addText(string_view text) {
+            Analyzer<true, true, PerfectHashView, SharedStemCache> analyzer (text, stopwords, SharedStemCache{&stem_cache}, use_simd);
+            Token token;
+            uint32_t expected = 0;
+            while (analyzer.next(token)) {
+                if (options.words > 0) {
+                    if (gap || token.position != expected) rolling.reset();
+                    gap = false;
+                    expected = token.position + 1;
+                    addSymbol(terms.intern(token.term));
+                    continue;
+                }
+                if (started) addSymbol(' ');
+                started = true;
+                for (char c : token.term) addSymbol((uint8_t) c);
+            }
+            if (analyzer.positions() != expected) gap = true;
+        }
+
+        // Writes the n-grams seen at least min_count times, one "n-gram count" per line in hash
+        // order, and returns how many there were
+        uint64_t write(ostream& out) {
+            string ngram;
+            return counter.finish(options.min_count, [&](const uint32_t* symbols, uint64_t count) {
+                ngram.clear();
+                if (options.words > 0) {
+                    for (int i = 0; i < options.words; i++) {
+                        if (i > 0) ngram += ' ';
+                        ngram.append(terms.term(symbols[i]));
+                    }
+                }
+                else {
+                    uint64_t bytes = (uint64_t) symbols[1] << 32 | symbols[0];
+                    for (int i = options.shingle - 1; i >= 0; i--) ngram += (char) (bytes >> (8 * i));
+                }
+                out << ngram << " " << count << "\n";
+            });
+        }
+
+        const NgramCounter& table() const { return counter; }
+};
+
+// Records the vocabulary size at the sampled collection sizes, given where each term first appeared
+// (sorted) and the total number of tokens
+void writeVocabGrowth(VocabGrowthRecorder& recorder, const vector<long long>& first_occurrences, long long collection_size) {
+    size_t vocab_size = 0;
+    for (long long tokens = recorder.next_point(); tokens <= collection_size; tokens = recorder.next_point()) {
+        while (vocab_size < first_occurrences.size() && first_occurrences[vocab_size] < tokens) vocab_size++;
+        recorder.record(tokens, vocab_size);
+    }
+    if (collection_size > 0) recorder.finish(collection_size, first_occurrences.size());
+}
+
+// Records the estimated vocabulary size at the sampled collection sizes by replaying register raises
+// (sorted by token) into a fresh sketch. If first_occurrences is not empty, returns the largest
+// relative error against the exact curve.
+double writeVocabGrowthEstimate(VocabGrowthRecorder& recorder, const vector<RegisterRaise>& raises, int precision,
+                                long long collection_size, double final_estimate, const vector<long long>& first_occurrences) {
+    HyperLogLog vocabulary (precision);
+    size_t next_raise = 0, vocab_size = 0;
+    double max_error = 0;
+    auto measure = [&](long long tokens, double estimate) {
+        if (first_occurrences.empty()) return;
+        while (vocab_size < first_occurrences.size() && first_occurrences[vocab_size] < tokens) vocab_size++;
+        max_error = std::max(max_error, abs(estimate - vocab_size) / vocab_size);
+    };
+    for (long long tokens = recorder.next_point(); tokens <= collection_size; tokens = recorder.next_point()) {
+        for (; next_raise < raises.size() && raises[next_raise].token < tokens; next_raise++) {
+            vocabulary.raise(raises[next_raise].index, raises[next_raise].rank);
+        }
+        recorder.record(tokens, llround(vocabulary.estimate()));
+        measure(tokens, vocabulary.estimate());
+    }
+    if (collection_size > 0) {
+        recorder.finish(collection_size, llround(final_estimate));
+        measure(collection_size, final_estimate);
+    }
+    return max_error;
+}
+
+// Times porterStem() against PorterStemmer, StemCache and StemBatch over every non-stopword token of the text
+void benchmarkStemmers(string_view text, bool use_simd, size_t stem_cache_bytes) {
+    vector<string> words;
+    TokenStream<> tokens (text, use_simd);
+    string_view token;
+    while (tokens.next(token)) {
+        if (!stopwords.contains(token)) words.emplace_back(token);
+    }
+
+    auto start_time = chrono::steady_clock::now();
+    size_t checksum = 0;
+    for (const string& w : words) checksum += porterStem(w).length();
+    double string_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    PorterStemmer stemmer;
+    start_time = chrono::steady_clock::now();
+    size_t buffer_checksum = 0;
+    for (const string& w : words) buffer_checksum += stemmer.stem(w).length();
+    double buffer_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    // Benchmark the cache at 1 MB unless a budget was given
+    StemCache cache (stem_cache_bytes > 0 ? stem_cache_bytes : 1 << 20);
+    start_time = chrono::steady_clock::now();
+    size_t cache_checksum = 0;
+    for (const string& w : words) cache_checksum += cache.stem(w).length();
+    double cache_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    size_t cache_hits = cache.hits();
+    size_t cache_misses = cache.misses();
+
+    // The batch is timed on its second use, once its memory has been allocated, as callers reuse it
+    vector<string_view> views (words.begin(), words.end());
+    StemBatch batch;
+    stem_batch(views.data(), views.size(), batch);
+    start_time = chrono::steady_clock::now();
+    stem_batch(views.data(), views.size(), batch);
+    size_t batch_checksum = 0;
+    for (size_t i = 0; i < batch.size(); i++) batch_checksum += batch[i].length();
+    double batch_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    // All must agree on every word
+    int mismatches = 0;
+    for (size_t i = 0; i < words.size(); i++) {
+        string expected = porterStem(words[i]);
+        if (expected != stemmer.stem(words[i]) || expected != cache.stem(words[i]) || expected != batch[i]) mismatches++;
+    }
+
+    cout << words.size() << " tokens, " << mismatches << " mismatches (checksums " << checksum << ", "
+         << buffer_checksum << ", " << cache_checksum << ", " << batch_checksum << ")" << endl;
+    cout << "porterStem:    " << string_seconds * 1e9 / words.size() << " ns/token" << endl;
+    cout << "PorterStemmer: " << buffer_seconds * 1e9 / words.size() << " ns/token" << endl;
+    cout << "StemCache:     " << cache_seconds * 1e9 / words.size() << " ns/token (" << cache_hits << " hits, "
+         << cache_misses << " misses)" << endl;
+    cout << "StemBatch:     " << batch_seconds * 1e9 / words.size() << " ns/token" << endl;
+}
+
+// Times stopword lookups in set<string> against the builtin and loaded perfect-hash tables
+void benchmarkStopwords(string_view text, bool use_simd, const char* filename) {
+    vector<string> list;
+    if (string(filename) == "builtin") list.assign(begin(BUILTIN_STOPWORDS), end(BUILTIN_STOPWORDS));
+    else list = readStopwords(filename);
+    set<string, less<>> stopword_set (list.begin(), list.end());
+    vector<string_view> views (list.begin(), list.end());
+    PerfectHashSet<DynamicHashStorage> runtime_table;
+    runtime_table.build(views.data(), views.size());
+
+    vector<string> words;
+    TokenStream<> tokens (text, use_simd);
+    string_view token;
+    while (tokens.next(token)) words.emplace_back(token);
+
+    auto start_time = chrono::steady_clock::now();
+    size_t set_hits = 0;
+    for (const string& w : words) set_hits += stopword_set.find(w) != stopword_set.end();
+    double set_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    start_time = chrono::steady_clock::now();
+    size_t builtin_hits = 0;
+    for (const string& w : words) builtin_hits += BUILTIN_STOPWORD_TABLE.contains(w);
+    double builtin_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    start_time = chrono::steady_clock::now();
+    size_t runtime_hits = 0;
+    for (const string& w : words) runtime_hits += runtime_table.contains(w);
+    double runtime_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    // The loaded table must agree with the set on every token
+    int mismatches = 0;
+    for (const string& w : words) if ((stopword_set.find(w) != stopword_set.end()) != runtime_table.contains(w)) mismatches++;
+
+    cout << words.size() << " tokens, " << mismatches << " mismatches, stopword hits " << set_hits << " (set), "
+         << builtin_hits << " (builtin), " << runtime_hits << " (loaded)" << endl;
+    cout << "set<string>:     " << set_seconds * 1e9 / words.size() << " ns/token" << endl;
+    cout << "builtin table:   " << builtin_seconds * 1e9 / words.size() << " ns/token (" << BUILTIN_STOPWORD_TABLE.memory() << " bytes)" << endl;
+    cout << "loaded table:    " << runtime_seconds * 1e9 / words.size() << " ns/token (" << runtime_table.memory() << " bytes)" << endl;
+}
+
+// Collects every token of text from a TokenStream
+template <bool Lowercase>
+vector<string> streamTokens(const string& text, bool use_simd) {
+    vector<string> tokens;
+    TokenStream<true, Lowercase> stream (text, use_simd);
+    string_view token;
+    while (stream.next(token)) tokens.emplace_back(token);
+    return tokens;
+}
+
+// Checks TokenStream's single-pass abbreviation folding and UTF-8 classification against abbreviate()
+// on random texts heavy in dots and multi-byte characters, returns the number that tokenized differently
+int fuzzAbbreviations(int iterations) {
+    // Letters, digits and delimiters of one to three UTF-8 bytes, plus bytes that are never valid UTF-8
+    // and continuation bytes that may end up stray
+    const char* alphabet[] = {"a", "B", "z", "0", "9", ".", ".", ".", ".", " ", " ", ",", "-", "\n", "\t", "'",
+                              "\xc3\xa9", "\xc3\x89", "\xd0\x96", "\xce\xa3", "\xe2\x80\x99", "\xe4\xb8\xad",
+                              "\xf0\x9d\x90\x80", "\xc2\xa0", "\xff", "\x80", "\xc3", "\xe2\x80"};
+    const size_t alphabet_size = sizeof(alphabet) / sizeof(alphabet[0]);
+    mt19937 random (12345);
+    int failures = 0;
+    for (int it = 0; it < iterations; it++) {
+        // Mostly short texts, now and then one long enough to span several windows
+        size_t length = it % 1000 == 999 ? 150000 + random() % 100000 : random() % 200;
+        string text;
+        for (size_t i = 0; i < length; i++) {
+            // Runs of ".x" make chained abbreviations likely
+            if (random() % 4 == 0) {
+                text += '.';
+                text += alphabet[random() % 3];
+            }
+            else text += alphabet[random() % alphabet_size];
+        }
+
+        for (int variant = 0; variant < 4; variant++) {
+            bool use_simd = variant & 1, lowercase = variant & 2;
+            vector<string> expected = referenceTokens(text, lowercase);
+            vector<string> actual = lowercase ? streamTokens<true>(text, use_simd) : streamTokens<false>(text, use_simd);
+            if (actual == expected) continue;
+            if (failures++ == 0) {
+                cout << "mismatch (simd " << use_simd << ", lowercase " << lowercase << ") on: " << text.substr(0, 200) << endl;
+            }
+            break;
+        }
+    }
+    cout << iterations << " texts, " << failures << " mismatches" << endl;
+    return failures;
 }
 
 int main(int argc, char **argv) {
-    if (argc < 3) cout << "To run: ./Tokenization stopwords.txt text.txt" << endl;
+    if (argc >= 2 && string(argv[1]) == "-fuzz-abbreviations") {
+        return fuzzAbbreviations(argc >= 3 ? atoi(argv[2]) : 100000) == 0 ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "-check-stopwords") {
+        return checkStopwords(argc >= 3 ? argv[2] : "stopwords.txt") == 0 ? 0 : 1;
+    }
+    if (argc < 3) {
+        cout << "To run: ./Tokenization stopwords.txt text.txt [-j threads] [-scalar] [-stem-cache bytes] [-top-k-memory bytes]" << endl;
+        cout << "                       [-vocab-hll precision] [-inflate-thread] [-pipeline workers]" << endl;
+        cout << "                       [-ngrams n | -shingles k] [-ngram-min count] [-ngram-memory bytes]" << endl;
+        cout << "                       [-vocab-every n | -vocab-log points] [-vocab-binary] [-bench-stem] [-bench-stopwords]" << endl;
+        cout << "    or: ./Tokenization -fuzz-abbreviations [texts]" << endl;
+        cout << "    or: ./Tokenization -check-stopwords stopwords.txt" << endl;
+        cout << "Passing 'builtin' for stopwords.txt uses the list compiled into the program" << endl;
+        cout << "text.txt may be gzip-compressed, it is then inflated and counted a piece at a time" << endl;
+        cout << "text.txt may also be a directory or a quoted glob pattern; every file is then counted into one terms.txt" << endl;
+        cout << "    on '-j' work-stealing threads, in path order, and file_stats.tsv lists per-file statistics" << endl;
+        cout << "'-j' splits the text into chunks counted on separate threads (default 1)" << endl;
+        cout << "'-pipeline' runs reading, tokenizing on the given number of workers and counting as separate stages" << endl;
+        cout << "    joined by lock-free queues, and reports how busy each stage was" << endl;
+        cout << "'-ngrams' counts word n-grams of 2-5 terms instead of single terms and writes ngrams.txt; n-grams do" << endl;
+        cout << "    not span a removed stopword" << endl;
+        cout << "'-shingles' counts character shingles of 2-8 bytes over the terms joined by spaces instead" << endl;
+        cout << "'-ngram-min' keeps only n-grams seen at least the given number of times (default 1)" << endl;
+        cout << "'-ngram-memory' bounds the n-gram table (default 256 MB), beyond it sorted runs are spilled to disk" << endl;
+        cout << "'-scalar' classifies characters without SIMD instructions" << endl;
+        cout << "'-stem-cache' memoizes stems in a cache of at most the given size (off by default)" << endl;
+        cout << "'-top-k-memory' finds the top terms with Space-Saving counters in at most the given size per thread" << endl;
+        cout << "    instead of counting every term; terms.txt then lists 'term count error', the true count lies" << endl;
+        cout << "    in [count - error, count], and vocabulary growth is only written with '-vocab-hll'" << endl;
+        cout << "'-vocab-hll' estimates the vocabulary growth with a HyperLogLog sketch of 2^precision registers (4-18)" << endl;
+        cout << "'-vocab-every' writes a vocabulary growth point every n tokens (default 1)" << endl;
+        cout << "'-vocab-log' writes the given number of log-spaced growth points per decade instead" << endl;
+        cout << "'-vocab-binary' writes vocab_growth.bin as delta-encoded varints instead of vocab_growth.csv" << endl;
+        cout << "'-inflate-thread' inflates compressed input on a background thread while counting" << endl;
+        cout << "'-bench-stem' times porterStem() against PorterStemmer on the text and exits" << endl;
+        cout << "'-bench-stopwords' times stopword lookups in set<string> against the hash tables and exits" << endl;
+        cout << "The stage benchmarks are a separate program, built from tokenizer_bench.cpp" << endl;
+        cout << "'-check-stopwords' fails if the builtin list differs from stopwords.txt, the build runs it" << endl;
+        cout << "'-fuzz-abbreviations' checks abbreviation folding against the original abbreviate() on random texts" << endl;
+        return -1;
+    }
 
-    // Get stopwords and store them in set<string>
+    // Parse optional flags
+    CountOptions options;
+    bool bench_stem = false;
+    bool bench_stopwords = false;
+    VocabSampling vocab_sampling = VocabSampling::EVERY;
+    long long vocab_step = 1;
+    bool vocab_binary = false;
+    bool inflate_thread = false;
+    int threads = 1;
+    int pipeline_workers = 0;
+    NgramOptions ngram_options;
+    for (int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "-pipeline" && i + 1 < argc) pipeline_workers = std::max(1, atoi(argv[++i]));
+        else if (arg == "-ngrams" && i + 1 < argc) ngram_options.words = std::clamp(atoi(argv[++i]), 2, 5);
+        else if (arg == "-shingles" && i + 1 < argc) ngram_options.shingle = std::clamp(atoi(argv[++i]), 2, 8);
+        else if (arg == "-ngram-min" && i + 1 < argc) ngram_options.min_count = std::max(1ULL, strtoull(argv[++i], nullptr, 10));
+        else if (arg == "-ngram-memory" && i + 1 < argc) ngram_options.memory_bytes = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-scalar") options.use_simd = false;
+        else if (arg == "-stem-cache" && i + 1 < argc) options.stem_cache_bytes = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-top-k-memory" && i + 1 < argc) options.top_k_bytes = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-vocab-hll" && i + 1 < argc) {
+            options.hll_precision = std::clamp(atoi(argv[++i]), HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+        }
+        else if (arg == "-vocab-every" && i + 1 < argc) vocab_step = atoll(argv[++i]);
+        else if (arg == "-vocab-log" && i + 1 < argc) {
+            vocab_sampling = VocabSampling::LOG;
+            vocab_step = atoll(argv[++i]);
+        }
+        else if (arg == "-vocab-binary") vocab_binary = true;
+        else if (arg == "-inflate-thread") inflate_thread = true;
+        else if (arg == "-bench-stem") bench_stem = true;
+        else if (arg == "-bench-stopwords") bench_stopwords = true;
+    }
+    if (ngram_options.words > 0 && ngram_options.shingle > 0) {
+        cout << "'-ngrams' and '-shingles' cannot be combined" << endl;
+        return -1;
+    }
+    size_t ngram_width = ngram_options.words > 0 ? ngram_options.words : 2;
+    if ((ngram_options.words > 0 || ngram_options.shingle > 0) && ngram_options.memory_bytes < NgramCounter::min_memory(ngram_width)) {
+        cout << "'-ngram-memory' must be at least " << NgramCounter::min_memory(ngram_width) << " bytes for this n-gram width" << endl;
+        return -1;
+    }
+    if (options.top_k_bytes > 0 && options.top_k_bytes < SpaceSaving::COUNTER_BYTES) {
+        cout << "'-top-k-memory' must be at least " << SpaceSaving::COUNTER_BYTES << " bytes, the size of one counter" << endl;
+        return -1;
+    }
+    if (pipeline_workers > 0 && (options.top_k_bytes > 0 || options.hll_precision > 0)) {
+        cout << "'-pipeline' counts every term exactly and cannot be combined with '-top-k-memory' or '-vocab-hll'" << endl;
+        return -1;
+    }
+
+    // Get stopwords and store them in a perfect-hash table
     getStopwords((const char*) argv[1]);
 
-    ifstream input_stream ((const char*) argv[2]);
-    ofstream vocab_growth_output ((const char*) "vocab_growth.csv");
-    int collection_size = 0;
+    // A directory or glob pattern is counted as one corpus. Otherwise plain files are mapped and
+    // compressed ones inflated as they are counted.
+    const char* filename = (const char*) argv[2];
+    bool corpus = isCorpus(filename);
+    vector<string> corpus_paths;
+    if (corpus) {
+        if (bench_stem || bench_stopwords || pipeline_workers > 0 || ngram_options.words > 0 || ngram_options.shingle > 0) {
+            cout << "'-bench-stem', '-bench-stopwords', '-pipeline', '-ngrams' and '-shingles' take a single text file" << endl;
+            return -1;
+        }
+        corpus_paths = listCorpus(filename);
+        if (corpus_paths.empty()) {
+            cout << "no files found" << endl;
+            return -1;
+        }
+    }
+    bool compressed = !corpus && is_gzip_file(filename);
+    unique_ptr<MappedFile> input_file;
+    unique_ptr<GzipReader> reader;
+    if (compressed) reader = make_unique<GzipReader>(filename, inflate_thread, INFLATE_BLOCK, PIECE_BYTES / INFLATE_BLOCK);
+    else if (!corpus) input_file = make_unique<MappedFile>(filename);
+    if (!corpus && (compressed ? !reader->is_open() : !input_file->is_open())) {
+        cout << "file could not be opened" << endl;
+        return -1;
+    }
+    if (bench_stem || bench_stopwords) {
+        string inflated;
+        if (compressed && !reader->read_all(inflated)) {
+            cout << "compressed file could not be read" << endl;
+            return -1;
+        }
+        string_view text = compressed ? string_view(inflated) : input_file->view();
+        if (bench_stem) benchmarkStemmers(text, options.use_simd, options.stem_cache_bytes);
+        else benchmarkStopwords(text, options.use_simd, (const char*) argv[1]);
+        return 0;
+    }
+
+    if (ngram_options.words > 0 || ngram_options.shingle > 0) {
+        auto start_time = chrono::steady_clock::now();
+        NgramExtractor extractor (ngram_options, options.use_simd, options.stem_cache_bytes);
+        long long input_bytes;
+        if (compressed) input_bytes = forEachPiece(*reader, PIECE_BYTES, [&](string_view piece) { extractor.addText(piece); });
+        else {
+            input_bytes = (long long) input_file->view().size();
+            extractor.addText(input_file->view());
+        }
+        if (input_bytes < 0) {
+            cout << "compressed file could not be read completely" << endl;
+            return -1;
+        }
+        ofstream ngram_stream ("ngrams.txt");
+        uint64_t kept = extractor.write(ngram_stream);
+        ngram_stream.close();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        const NgramCounter& table = extractor.table();
+        if (table.failed()) {
+            cout << "n-gram runs could not be written to or read back from disk, ngrams.txt is incomplete" << endl;
+            return -1;
+        }
+        cout << "Counted " << table.total() << (ngram_options.words > 0 ? " word n-grams" : " shingles") << " in " << seconds << " s, "
+             << kept << " distinct seen at least " << ngram_options.min_count << " times" << endl;
+        cout << "N-gram table: at most " << table.memory() << " bytes, spilled to disk " << table.spills() << " times (" << table.spilled()
+             << " records)" << endl;
+        return 0;
+    }
 
-    string word;
-    while(getline(input_stream, word, ' ')) {
-        // Abbreviate
-        word = abbreviate(word);
-        // Remove Punctuation
-        word = removePunc(word);
-        // Lowercase
-        for (int i = 0; i < word.length(); i++) word[i] = tolower(word[i]);
-        // Stopword removal
-        if (stopwords.find(word) != stopwords.end() || word.length() == 0 || (word.length() == 1 && !isalnum(word[0]))) continue;
-        // Porter Stemming
-        word = porterStem(word);
-        // Increment collection size
-        collection_size++;
-        // Store in map
-        if (token_counter.find(word) != token_counter.end()) token_counter[word]++;
-        else  token_counter.insert(pair<string, int>(word, 1));
-        // Write data to file
-        vocab_growth_output << collection_size << "," << token_counter.size() << endl;
-
-    }
-    for (int i = 0; i < input.size(); i++) {
-        word = input[i];
-        // Remove Punctuation
-        word = removePunc(word);
-        // Lowercase
-        for (int i = 0; i < word.length(); i++) word[i] = tolower(word[i]);
-        // Stopword removal
-        if (stopwords.find(word) != stopwords.end() || word.length() == 0 || (word.length() == 1 && !isalnum(word[0]))) continue;
-        // Porter Stemming
-        word = porterStem(word);
-        // Increment collection size
-        collection_size++;
-        // Store in map
-        if (token_counter.find(word) != token_counter.end()) token_counter[word]++;
-        else  token_counter.insert(pair<string, int>(word, 1));
-        // Write data point to file
-        vocab_growth_output << collection_size << "," << token_counter.size() << endl;
+    // Count each chunk on its own thread
+    auto start_time = chrono::steady_clock::now();
+    CollectionCounts collection;
+    collection.heavy_hitters = SpaceSaving(options.top_k_bytes);
+    collection.vocabulary = HyperLogLog(std::max(options.hll_precision, HLL_MIN_PRECISION));
+    size_t chunk_count = 0;
+    long long input_bytes;
+    PipelineStats pipeline_stats;
+    vector<CorpusFile> corpus_files;
+    WorkStealingPool pool (threads);
+    if (corpus) {
+        input_bytes = countCorpus(corpus_paths, pool, options, collection, corpus_files);
+        chunk_count = pool.size();
+    }
+    else if (pipeline_workers > 0) {
+        input_bytes = countPipelined(compressed ? string_view() : input_file->view(), reader.get(), pipeline_workers, options,
+                                     collection, pipeline_stats);
+        chunk_count = pipeline_workers + 2;
+    }
+    else if (compressed) {
+        input_bytes = forEachPiece(*reader, PIECE_BYTES, [&](string_view piece) {
+            chunk_count = std::max(chunk_count, countText(piece, threads, options, collection));
+        });
+    }
+    else {
+        input_bytes = (long long) input_file->view().size();
+        chunk_count = countText(input_file->view(), threads, options, collection);
     }
-    input_stream.close();
-    vocab_growth_output.close();
+    if (input_bytes < 0) {
+        cout << (corpus ? "corpus" : "compressed file") << " could not be read completely" << endl;
+        return -1;
+    }
+    const vector<long long>& first_occurrences = collection.first_occurrences;
+    long long collection_size = collection.collection_size;
+    HyperLogLog& vocabulary = collection.vocabulary;
+    SpaceSaving& heavy_hitters = collection.heavy_hitters;
 
-    // Get map items sorted by value
-    mapSort(token_counter);
+    // Rebuild the vocabulary growth curve from where each term first appeared, or estimate it
+    double vocabulary_error = 0;
+    if (options.top_k_bytes == 0 || options.hll_precision > 0) {
+        VocabGrowthRecorder recorder (vocab_binary ? "vocab_growth.bin" : "vocab_growth.csv", vocab_sampling, vocab_step, vocab_binary);
+        if (!recorder.is_open()) cout << "vocabulary growth file could not be opened" << endl;
+        else if (options.hll_precision > 0) {
+            vocabulary_error = writeVocabGrowthEstimate(recorder, collection.raises, options.hll_precision, collection_size,
+                                                        vocabulary.estimate(), first_occurrences);
+        }
+        else writeVocabGrowth(recorder, first_occurrences, collection_size);
+    }
+
+    // Report throughput over the (uncompressed) input
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    double megabytes = input_bytes / (1024.0 * 1024.0);
+    cout << "Tokenized " << megabytes << " MB" << (compressed ? " (inflated)" : "") << " in " << seconds << " s ("
+         << megabytes / seconds << " MB/s) on " << chunk_count << " thread(s)" << endl;
+    if (pipeline_workers > 0) printPipelineStats(pipeline_stats);
+    if (corpus) writeCorpusStats(corpus_files, pool);
+    if (options.stem_cache_bytes > 0) {
+        cout << "Stem cache: " << collection.stem_hits << " hits, " << collection.stem_misses << " misses, " << collection.stem_evictions
+             << " evictions (" << options.stem_cache_bytes << " bytes per thread)" << endl;
+    }
+    if (options.hll_precision > 0) {
+        cout << "HyperLogLog: " << vocabulary.memory() << " registers, estimated vocabulary " << llround(vocabulary.estimate());
+        if (!first_occurrences.empty()) {
+            cout << " (exact " << first_occurrences.size() << ", largest error along the curve " << vocabulary_error * 100 << "%)";
+        }
+        cout << endl;
+    }
 
     // Write word and freq to files
     ofstream output_stream ((const char*) "terms.txt");
-    int max = min(200, token_freq.size());
-    for (int i = 0; i < max; i++) {
-        output_stream << token_freq[i].first << " " << token_freq[i].second << endl;
+    if (options.top_k_bytes > 0) {
+        // Counts are upper bounds, each within its error and within total / counters of the truth
+        for (const HeavyHitter& hitter : heavy_hitters.top(200)) {
+            output_stream << hitter.term << " " << hitter.count << " " << hitter.error << endl;
+        }
+        cout << "Space-Saving: " << heavy_hitters.capacity() << " counters, " << heavy_hitters.memory()
+             << " bytes, counts overestimate by at most " << heavy_hitters.total() / std::max<size_t>(1, heavy_hitters.capacity()) << endl;
+    }
+    else {
+        // Get map items sorted by value
+        mapSort(token_counter, 200);
+        int max = min(200, token_freq.size());
+        for (int i = 0; i < max; i++) {
+            output_stream << token_counter.term(token_freq[i]) << " " << token_counter.count(token_freq[i]) << endl;
+        }
     }
     output_stream.close();
 
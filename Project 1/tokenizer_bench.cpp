@@ -0,0 +1,320 @@
+/*
+ * Build: g++ -std=c++17 -O2 -march=native -pthread tokenizer_bench.cpp -o TokenizationBench -lz
+ *
+ * Stage-level benchmarks of the tokenizer. Kept out of the tokenizer itself, because counting
+ * allocations means replacing the global operator new for the whole program.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <string_view>
+#include <random>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "../common/analyzer.hpp"
+#include "../common/gzip_reader.hpp"
+#include "../common/stemmer.hpp"
+#include "../common/stopword_table.hpp"
+#include "reference_tokenizer.hpp"
+#include "stem_cache.hpp"
+#include "term_dictionary.hpp"
+
+using namespace std;
+
+PerfectHashView stopwords;
+PerfectHashSet<DynamicHashStorage> loaded_stopwords;
+
+// Every heap allocation is counted, so each stage can report allocations per token
+atomic<size_t> allocation_count {0};
+
+// None are inlined, so the compiler does not pair malloc() and free() with the builtin new and delete
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Reads the stopword list, one word per line, returns false if it could not be opened
+bool readStopwords(const char* filename, vector<string>& words) {
+    ifstream stopwords_stream (filename);
+    if (!stopwords_stream.is_open()) return false;
+    string word;
+    while (getline(stopwords_stream, word, '\n')) words.push_back(word);
+    return true;
+}
+
+// Builds a synthetic text of the given number of words drawn from a Zipfian distribution (s = 1)
+// over a fixed random vocabulary, with some capitals, punctuation and abbreviations mixed in
+string zipfText(size_t words, size_t vocabulary_size, uint64_t seed) {
+    mt19937_64 random (seed);
+    vector<string> vocabulary (vocabulary_size);
+    for (string& word : vocabulary) {
+        size_t length = 2 + random() % 6 + random() % 6;
+        for (size_t i = 0; i < length; i++) word += (char) ('a' + random() % 26);
+    }
+    vector<double> cumulative (vocabulary_size);
+    double sum = 0;
+    for (size_t r = 0; r < vocabulary_size; r++) cumulative[r] = sum += 1.0 / (r + 1);
+
+    string text;
+    uniform_real_distribution<double> uniform (0, sum);
+    for (size_t i = 0; i < words; i++) {
+        size_t rank = std::min(vocabulary_size - 1, (size_t) (upper_bound(cumulative.begin(), cumulative.end(), uniform(random)) - cumulative.begin()));
+        string word = vocabulary[rank];
+        int decoration = random() % 100;
+        if (decoration < 10) word[0] = (char) (word[0] - 'a' + 'A');
+        else if (decoration < 12 && word.size() <= 4) {
+            string abbreviation;
+            for (char c : word) abbreviation += string(1, (char) (c - 'a' + 'A')) + ".";
+            word = abbreviation;
+        }
+        text += word;
+        if (decoration >= 95) text += decoration % 2 ? "," : ".";
+        text += i % 16 == 15 ? '\n' : ' ';
+    }
+    return text;
+}
+
+// Timing of one stage over one input, the fastest of several repetitions
+struct StageResult {
+    string stage;
+    string input;
+    size_t tokens;
+    size_t bytes;
+    double seconds;
+    size_t allocations;
+};
+
+// Runs run() repetitions times and keeps the fastest run and its allocation count. run() returns a
+// checksum so the work cannot be optimized away.
+template <class Run>
+StageResult timeStage(const string& stage, const string& input, size_t tokens, size_t bytes, int repetitions, Run run) {
+    StageResult result {stage, input, tokens, bytes, 0, 0};
+    static volatile size_t sink;
+    for (int i = 0; i < repetitions; i++) {
+        size_t allocations = allocation_count.load(memory_order_relaxed);
+        auto start_time = chrono::steady_clock::now();
+        sink = sink + run();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        allocations = allocation_count.load(memory_order_relaxed) - allocations;
+        if (i == 0 || seconds < result.seconds) {
+            result.seconds = seconds;
+            result.allocations = allocations;
+        }
+    }
+    return result;
+}
+
+size_t totalLength(const vector<string>& words) {
+    size_t bytes = 0;
+    for (const string& w : words) bytes += w.size();
+    return bytes;
+}
+
+// Times each tokenizer stage on its own, the original implementations next to their replacements.
+// Each stage gets the output of the stages before it, prepared with the reference code.
+void benchmarkStages(const string& input, const string& text, const set<string, less<>>& stopword_set, int repetitions,
+                     vector<StageResult>& results) {
+    vector<string> words;
+    for (size_t i = 0; i < text.size();) {
+        while (i < text.size() && is_space_byte(text[i])) i++;
+        size_t start = i;
+        while (i < text.size() && !is_space_byte(text[i])) i++;
+        if (i > start) words.push_back(text.substr(start, i - start));
+    }
+    vector<string> abbreviated = words;
+    for (string& w : abbreviated) abbreviate(w);
+    vector<string> raw_tokens = referenceTokens(text, false);
+    vector<string> tokens = referenceTokens(text, true);
+    vector<string> content;
+    for (const string& t : tokens) if (!stopwords.contains(t)) content.push_back(t);
+    vector<string> stems;
+    for (const string& t : content) stems.push_back(porterStem(t));
+
+    auto add = [&](const string& stage, size_t count, size_t bytes, auto run) {
+        results.push_back(timeStage(stage, input, count, bytes, repetitions, run));
+    };
+    string scratch;
+    add("abbreviate (original)", words.size(), totalLength(words), [&] {
+        size_t sum = 0;
+        for (const string& w : words) {
+            scratch.assign(w);
+            sum += abbreviate(scratch).size();
+        }
+        return sum;
+    });
+    add("removePunc (original)", abbreviated.size(), totalLength(abbreviated), [&] {
+        size_t sum = 0;
+        vector<string> rest;
+        for (const string& w : abbreviated) {
+            sum += removePunc(w, rest).size();
+            while (!rest.empty()) {
+                string next = std::move(rest.back());
+                rest.pop_back();
+                sum += removePunc(next, rest).size();
+            }
+        }
+        return sum;
+    });
+    add("lowercase (original)", raw_tokens.size(), totalLength(raw_tokens), [&] {
+        size_t sum = 0;
+        for (const string& t : raw_tokens) {
+            scratch.assign(t);
+            for (size_t i = 0; i < scratch.length(); i++) scratch[i] = tolower(scratch[i]);
+            sum += (uint8_t) scratch[0];
+        }
+        return sum;
+    });
+    add("stopwords set<string>", tokens.size(), totalLength(tokens), [&] {
+        size_t hits = 0;
+        for (const string& t : tokens) hits += stopword_set.find(t) != stopword_set.end();
+        return hits;
+    });
+    add("stopwords perfect hash", tokens.size(), totalLength(tokens), [&] {
+        size_t hits = 0;
+        for (const string& t : tokens) hits += stopwords.contains(t);
+        return hits;
+    });
+    add("porterStem (original)", content.size(), totalLength(content), [&] {
+        size_t sum = 0;
+        for (const string& t : content) sum += porterStem(t).size();
+        return sum;
+    });
+    PorterStemmer stemmer;
+    add("PorterStemmer", content.size(), totalLength(content), [&] {
+        size_t sum = 0;
+        for (const string& t : content) sum += stemmer.stem(t).size();
+        return sum;
+    });
+    vector<string_view> content_views (content.begin(), content.end());
+    StemBatch batch;
+    add("StemBatch", content.size(), totalLength(content), [&] {
+        stem_batch(content_views.data(), content_views.size(), batch);
+        size_t sum = 0;
+        for (size_t i = 0; i < batch.size(); i++) sum += batch[i].size();
+        return sum;
+    });
+    // The cache outlives the repetitions, so the fastest one runs warm
+    StemCache cache (1 << 20);
+    add("StemCache 1 MB (warm)", content.size(), totalLength(content), [&] {
+        size_t sum = 0;
+        for (const string& t : content) sum += cache.stem(t).size();
+        return sum;
+    });
+    add("TermDictionary", stems.size(), totalLength(stems), [&] {
+        TermDictionary terms;
+        for (const string& t : stems) terms.add(t);
+        return (size_t) terms.size();
+    });
+    for (bool use_simd : {true, false}) {
+        add(use_simd ? "TokenStream SIMD" : "TokenStream scalar", tokens.size(), text.size(), [&] {
+            TokenStream<> stream (text, use_simd);
+            string_view token;
+            size_t sum = 0;
+            while (stream.next(token)) sum += token.size();
+            return sum;
+        });
+    }
+    add("Analyzer (all stages)", tokens.size(), text.size(), [&] {
+        Analyzer<true, true, PerfectHashView, PorterStemmer> analyzer (text, stopwords);
+        Token token;
+        size_t sum = 0;
+        while (analyzer.next(token)) sum += token.term.size();
+        return sum;
+    });
+}
+
+// Escapes a string for a JSON value
+string jsonString(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Runs the stage benchmarks on the given texts and a Zipfian stream, prints a table and optionally
+// writes the results as JSON
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cout << "To run: ./TokenizationBench stopwords.txt [text.txt ...] [-json file] [-zipf words] [-reps n]" << endl;
+        cout << "Times each stage, original and current, on part-A, part-B (or the given texts) and a Zipfian stream," << endl;
+        cout << "    reporting ns/token, MB/s and allocations/token, optionally as JSON" << endl;
+        cout << "Passing 'builtin' for stopwords.txt uses the list compiled into the program" << endl;
+        return -1;
+    }
+    vector<string> files;
+    string json_file;
+    size_t zipf_words = 1000000;
+    int repetitions = 5;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-json" && i + 1 < argc) json_file = argv[++i];
+        else if (arg == "-zipf" && i + 1 < argc) zipf_words = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-reps" && i + 1 < argc) repetitions = std::max(1, atoi(argv[++i]));
+        else files.push_back(arg);
+    }
+    if (files.empty()) files = {"tokenization-input-part-A.txt", "tokenization-input-part-B.txt"};
+    // Stopwords go into a perfect-hash table like the tokenizer's, and into a set for the original lookup
+    vector<string> list;
+    if (string(argv[1]) == "builtin") {
+        list.assign(begin(BUILTIN_STOPWORDS), end(BUILTIN_STOPWORDS));
+        stopwords = BUILTIN_STOPWORD_TABLE.view();
+    }
+    else {
+        if (!readStopwords(argv[1], list)) {
+            cout << "stopword file could not be opened" << endl;
+            return -1;
+        }
+        vector<string_view> views (list.begin(), list.end());
+        if (!loaded_stopwords.build(views.data(), views.size())) {
+            cout << "could not build a perfect hash for the stopword list" << endl;
+            return -1;
+        }
+        stopwords = loaded_stopwords.view();
+    }
+    set<string, less<>> stopword_set (list.begin(), list.end());
+
+    vector<StageResult> results;
+    for (const string& file : files) {
+        GzipReader reader (file.c_str());
+        string text;
+        if (!reader.is_open() || !reader.read_all(text)) {
+            cout << file << " could not be read" << endl;
+            return -1;
+        }
+        benchmarkStages(file, text, stopword_set, repetitions, results);
+    }
+    if (zipf_words > 0) benchmarkStages("zipf-" + to_string(zipf_words), zipfText(zipf_words, 50000, 42), stopword_set, repetitions, results);
+
+    for (const StageResult& r : results) {
+        double tokens = (double) std::max<size_t>(1, r.tokens);
+        printf("%-28s %-34s %10.2f ns/token %9.1f MB/s %7.3f allocs/token\n", r.stage.c_str(), r.input.c_str(),
+               r.seconds * 1e9 / tokens, r.bytes / (1024.0 * 1024.0) / r.seconds, r.allocations / tokens);
+    }
+    if (!json_file.empty()) {
+        ofstream json (json_file);
+        json << "[" << endl;
+        for (size_t i = 0; i < results.size(); i++) {
+            const StageResult& r = results[i];
+            double tokens = (double) std::max<size_t>(1, r.tokens);
+            json << "  {\"stage\": " << jsonString(r.stage) << ", \"input\": " << jsonString(r.input) << ", \"tokens\": " << r.tokens
+                 << ", \"bytes\": " << r.bytes << ", \"seconds\": " << r.seconds << ", \"ns_per_token\": " << r.seconds * 1e9 / tokens
+                 << ", \"bytes_per_second\": " << r.bytes / r.seconds << ", \"allocations_per_token\": " << r.allocations / tokens << "}"
+                 << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        json << "]" << endl;
+    }
+    return 0;
+}
+
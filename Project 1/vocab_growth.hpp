@@ -0,0 +1,101 @@
+/*
+ * Vocabulary growth recorder.
+ * Writes (collection size, vocabulary size) points through a large user-space buffer instead of
+ * one flushed line per token. Points can be taken at every token, every N tokens, or at a fixed
+ * number of log-spaced positions per decade, and the final point is always written so Heaps' law
+ * fits see the exact collection and vocabulary size. The text format is the "tokens,vocab" CSV.
+ * The binary format is the magic "VGB2" followed by both values of each point as LEB128 varints
+ * of the difference from the previous point. Collection sizes only grow, but HyperLogLog estimates
+ * of the vocabulary can drop, so the vocabulary difference is zigzag-encoded (0, -1, 1, -2, ... as
+ * 0, 1, 2, 3, ...).
+ */
+
+#ifndef VOCAB_GROWTH_HPP
+#define VOCAB_GROWTH_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+enum class VocabSampling { EVERY, LOG };
+
+class VocabGrowthRecorder {
+    std::ofstream output;
+    std::vector<char> buffer;
+    size_t used = 0;
+    VocabSampling sampling;
+    long long step;             // Tokens between points (EVERY) or points per decade (LOG)
+    bool binary;
+    long long log_index = 0;
+    long long last_tokens = 0;
+    long long last_vocab = 0;
+
+    void flush() {
+        output.write(buffer.data(), used);
+        used = 0;
+    }
+
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer[used++] = (char) (value | 0x80);
+            value >>= 7;
+        }
+        buffer[used++] = (char) value;
+    }
+
+    // Maps signed differences to unsigned ones with small magnitudes kept small
+    static uint64_t zigzag(long long value) { return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63); }
+
+    void putNumber(long long value) { used = std::to_chars(&buffer[used], &buffer[used] + 20, value).ptr - buffer.data(); }
+
+    public:
+        // step is the number of tokens between points, or the points per decade for VocabSampling::LOG
+        VocabGrowthRecorder(const char* filename, VocabSampling sampling = VocabSampling::EVERY, long long step = 1,
+                            bool binary = false, size_t buffer_bytes = 1 << 20)
+            : output(filename, std::ios::binary), buffer(std::max<size_t>(buffer_bytes, 64)), sampling(sampling),
+              step(std::max(1LL, step)), binary(binary) {
+            if (binary) output.write("VGB2", 4);
+        }
+
+        ~VocabGrowthRecorder() { flush(); }
+
+        bool is_open() const { return output.is_open(); }
+
+        // Returns the collection size of the next point to record
+        long long next_point() {
+            if (sampling == VocabSampling::EVERY) return last_tokens + step;
+            long long point;
+            do point = std::llround(std::pow(10.0, (double) log_index++ / step));
+            while (point <= last_tokens);
+            return point;
+        }
+
+        // Appends a point, collection sizes must increase from call to call
+        void record(long long tokens, long long vocab) {
+            if (used + 42 > buffer.size()) flush();
+            if (binary) {
+                putVarint(tokens - last_tokens);
+                putVarint(zigzag(vocab - last_vocab));
+            }
+            else {
+                putNumber(tokens);
+                buffer[used++] = ',';
+                putNumber(vocab);
+                buffer[used++] = '\n';
+            }
+            last_tokens = tokens;
+            last_vocab = vocab;
+        }
+
+        // Writes the final point unless sampling already landed on it, then flushes the buffer
+        void finish(long long tokens, long long vocab) {
+            if (tokens > last_tokens) record(tokens, vocab);
+            flush();
+            output.flush();
+        }
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Work-stealing thread pool for a fixed set of tasks.
+ * Every worker owns a deque of task numbers. It takes its own work from the back and, once that
+ * runs dry, steals from the front of another worker's deque, so one worker stuck on a long task
+ * does not leave the rest idle while work is still queued behind it. Tasks are all queued before
+ * run() and the pool is done when every deque is empty.
+ */
+
+#ifndef WORK_STEALING_HPP
+#define WORK_STEALING_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+    struct alignas(64) WorkerQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+        size_t run = 0;
+        size_t stolen = 0;
+    };
+
+    std::vector<WorkerQueue> queues;
+
+    // Takes a task for worker w, its own newest first, then the oldest of any other worker
+    bool take(size_t w, size_t& task) {
+        {
+            std::lock_guard<std::mutex> guard (queues[w].lock);
+            if (!queues[w].tasks.empty()) {
+                task = queues[w].tasks.back();
+                queues[w].tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            WorkerQueue& victim = queues[(w + i) % queues.size()];
+            std::lock_guard<std::mutex> guard (victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                queues[w].stolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    public:
+        explicit WorkStealingPool(int threads) : queues(threads < 1 ? 1 : threads) {}
+
+        // Queues task on worker w; call before run()
+        void push(size_t w, size_t task) { queues[w % queues.size()].tasks.push_back(task); }
+
+        // Runs every queued task as run_task(task, worker) and returns once all are done
+        template <class RunTask>
+        void run(RunTask run_task) {
+            std::vector<std::thread> threads;
+            for (size_t w = 0; w < queues.size(); w++) {
+                threads.emplace_back([this, w, &run_task] {
+                    size_t task;
+                    while (take(w, task)) {
+                        run_task(task, w);
+                        queues[w].run++;
+                    }
+                });
+            }
+            for (std::thread& thread : threads) thread.join();
+        }
+
+        // Returns the number of workers
+        size_t size() const { return queues.size(); }
+
+        // Returns the tasks worker w ran, and how many of them it stole
+        size_t tasks_run(size_t w) const { return queues[w].run; }
+        size_t steals(size_t w) const { return queues[w].stolen; }
+};
+
+#endif
@@ -0,0 +1,531 @@
+/*
+ * Link graph kept on disk, for graphs whose links do not fit in memory.
+ * The pages are split into ranges of consecutive ids and the links pointing into each range are
+ * stored in one file, grouped by target page, each target's sources sorted and delta-encoded as
+ * varints. An iteration streams the files one after another with a fixed-size buffer, so besides
+ * the rank vectors only the out-degrees and one buffer per thread are held in memory. The files are
+ * built by streaming the link file: the URLs are split into hash buckets, each small enough to
+ * intern within half the memory budget, taking one pass over the link file per bucket; the buckets
+ * are merged on disk into the URL file, the links are spilled as id pairs, scattered into a raw file
+ * per range and each range is sorted, stripped of duplicate links and encoded in turn. Ranges are
+ * sized so one range's links fit the memory budget. The build still keeps a few per-page arrays
+ * (up to 20 bytes a page) in memory, which the budget does not cover.
+ */
+
+#ifndef EDGE_PARTITIONS_HPP
+#define EDGE_PARTITIONS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "link_loader.hpp"
+
+// Largest number of range files written at once while scattering the links
+const size_t MAX_PARTITIONS = 1000;
+
+// Largest number of URL buckets, and so of passes over the link file; at this many the last
+// attempt keeps every bucket whatever its size
+const size_t MAX_URL_BUCKETS = 256;
+
+// Reads a file a buffer at a time and decodes varints from it
+class VarintReader {
+    FILE* file;
+    std::vector<uint8_t>& buffer;
+    size_t pos = 0;
+    size_t end = 0;
+
+    // Moves the unread bytes to the front and fills the rest of the buffer
+    void refill() {
+        std::copy(buffer.begin() + pos, buffer.begin() + end, buffer.begin());
+        end -= pos;
+        pos = 0;
+        end += fread(buffer.data() + end, 1, buffer.size() - end, file);
+    }
+
+    public:
+        VarintReader(FILE* file, std::vector<uint8_t>& buffer) : file(file), buffer(buffer) {}
+
+        // Decodes the next varint into value. Returns false if the file ends within it, the varint
+        // is longer than a 32-bit value needs, or the file could not be read.
+        bool next(uint32_t& value) {
+            // A varint of a 32-bit value is at most 5 bytes
+            if (end - pos < 5) refill();
+            value = 0;
+            for (int shift = 0; pos < end && shift < 35; shift += 7) {
+                uint8_t byte = buffer[pos++];
+                value |= (uint32_t) (byte & 0x7f) << shift;
+                if (byte < 0x80) return true;
+            }
+            return false;
+        }
+
+        // Returns true if reading the file failed
+        bool failed() const { return ferror(file) != 0; }
+};
+
+inline void write_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t) value);
+}
+
+// Reads a file a line at a time through a buffer, which only grows for a line longer than it
+class LineReader {
+    FILE* file;
+    std::vector<char> buffer;
+    size_t pos = 0;
+    size_t end = 0;
+    bool at_end = false;
+
+    public:
+        LineReader(FILE* file, size_t buffer_bytes) : file(file), buffer(buffer_bytes) {}
+
+        // Stores the next line in line, without its newline, returns false at the end of the file.
+        // The line is valid until the next call.
+        bool next(std::string_view& line) {
+            while (true) {
+                const char* newline = (const char*) memchr(buffer.data() + pos, '\n', end - pos);
+                if (newline) {
+                    line = std::string_view(buffer.data() + pos, newline - (buffer.data() + pos));
+                    pos = newline - buffer.data() + 1;
+                    return true;
+                }
+                if (at_end) {
+                    // The last line may have no newline
+                    line = std::string_view(buffer.data() + pos, end - pos);
+                    bool found = pos < end;
+                    pos = end;
+                    return found;
+                }
+                std::copy(buffer.begin() + pos, buffer.begin() + end, buffer.begin());
+                end -= pos;
+                pos = 0;
+                if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+                size_t read = fread(buffer.data() + end, 1, buffer.size() - end, file);
+                end += read;
+                if (read == 0) at_end = true;
+            }
+        }
+
+        // Returns true if reading the file failed
+        bool failed() const { return ferror(file) != 0; }
+};
+
+class EdgePartitions {
+    struct Partition {
+        uint32_t first;     // Pages [first, last) are the targets of the partition's links
+        uint32_t last;
+        uint64_t links;
+        uint64_t bytes;
+        std::string path;
+    };
+
+    std::string directory;
+    size_t memory_budget;
+    std::vector<Partition> partitions;
+    std::vector<uint32_t> degrees;
+    std::vector<uint32_t> inlink_counts;
+    uint64_t link_count = 0;
+    std::string url_path;
+    std::string url_index_path;
+    size_t url_passes = 0;
+
+    std::string path(const std::string& name) const { return directory + "/" + name; }
+
+    // Splits the pages into ranges whose raw links fit the memory budget as 8-byte pairs; a page with
+    // more links than that gets a range of its own
+    void splitRanges(const std::vector<uint64_t>& raw_links) {
+        size_t n = raw_links.size();
+        uint64_t budget_links = std::max<uint64_t>(1, memory_budget / 8);
+        uint64_t total = 0;
+        for (uint64_t links : raw_links) total += links;
+        budget_links = std::max(budget_links, (total + MAX_PARTITIONS - 1) / MAX_PARTITIONS);
+
+        uint32_t first = 0;
+        uint64_t links = 0;
+        for (uint32_t v = 0; v < n; v++) {
+            if (v > first && links + raw_links[v] > budget_links) {
+                partitions.push_back(Partition {first, v, 0, 0, path("links." + std::to_string(partitions.size()))});
+                first = v;
+                links = 0;
+            }
+            links += raw_links[v];
+        }
+        partitions.push_back(Partition {first, (uint32_t) n, 0, 0, path("links." + std::to_string(partitions.size()))});
+    }
+
+    // Sorts the raw links of partition p by target then source, drops duplicates, counts out-degrees
+    // and writes the encoded file over the raw one
+    bool encode(Partition& p, std::vector<uint64_t>& pairs, std::vector<uint8_t>& out) {
+        FILE* raw = fopen((p.path + ".raw").c_str(), "rb");
+        if (!raw) return false;
+        pairs.clear();
+        std::vector<uint32_t> block (1 << 18);
+        size_t read;
+        while ((read = fread(block.data(), sizeof(uint32_t), block.size(), raw)) >= 2) {
+            for (size_t i = 0; i + 1 < read; i += 2) pairs.push_back((uint64_t) block[i + 1] << 32 | block[i]);
+        }
+        fclose(raw);
+        remove((p.path + ".raw").c_str());
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        FILE* file = fopen(p.path.c_str(), "wb");
+        if (!file) return false;
+        bool written = true;
+        size_t e = 0;
+        for (uint32_t v = p.first; v < p.last && written; v++) {
+            size_t begin = e;
+            while (e < pairs.size() && pairs[e] >> 32 == v) e++;
+            write_varint(out, (uint32_t) (e - begin));
+            uint32_t previous = 0;
+            for (size_t i = begin; i < e; i++) {
+                uint32_t source = (uint32_t) pairs[i];
+                degrees[source]++;
+                write_varint(out, source - previous);
+                previous = source;
+            }
+            if (out.size() >= (1 << 20)) {
+                written = fwrite(out.data(), 1, out.size(), file) == out.size();
+                p.bytes += out.size();
+                out.clear();
+            }
+        }
+        written = written && fwrite(out.data(), 1, out.size(), file) == out.size();
+        p.bytes += out.size();
+        out.clear();
+        p.links = pairs.size();
+        link_count += pairs.size();
+        return fclose(file) == 0 && written;
+    }
+
+    enum class Interned { DONE, OVER_BUDGET, FAILED };
+
+    std::string bucketPath(size_t bucket) const { return path("urls.bucket." + std::to_string(bucket)); }
+
+    // Interns the URLs of the link file whose hash falls in bucket out of buckets, numbered from
+    // base in order of first appearance, and writes them to the bucket's file, each with the first
+    // place it occurs at (2 * line, plus 1 for the link). The page and link ids of every line are
+    // copied from spill_in (none for the first bucket) to spill_out, with this bucket's URLs filled
+    // in. raw_links counts the lines naming each URL as the target. Gives up with OVER_BUDGET once
+    // the table takes more than half the memory budget, unless fit_budget is false.
+    Interned internBucket(const char* filename, size_t bucket, size_t buckets, uint32_t base, bool fit_budget,
+                          const std::string& spill_in, const std::string& spill_out,
+                          std::vector<uint64_t>& raw_links, uint32_t& count) {
+        FILE* file = fopen(filename, "rb");
+        FILE* in = bucket > 0 ? fopen(spill_in.c_str(), "rb") : nullptr;
+        FILE* out = fopen(spill_out.c_str(), "wb");
+        auto close = [&] {
+            bool closed = true;
+            if (file) fclose(file);
+            if (in) fclose(in);
+            if (out) closed = fclose(out) == 0;
+            return closed;
+        };
+        if (!file || (bucket > 0 && !in) || !out) {
+            close();
+            return Interned::FAILED;
+        }
+
+        LineReader lines (file, 1 << 20);
+        UrlTable urls;
+        std::vector<uint64_t> firsts;
+        std::vector<uint32_t> pairs (1 << 18);
+        size_t used = 0, filled = 0;
+        uint64_t line_number = 0;
+        bool valid = true;
+        std::string_view line;
+        while (valid && lines.next(line)) {
+            size_t tab = line.find('\t');
+            if (tab == std::string_view::npos) continue;
+            if (used == filled) {
+                // Pass the ids on a block at a time
+                valid = fwrite(pairs.data(), sizeof(uint32_t), used, out) == used;
+                filled = in ? fread(pairs.data(), sizeof(uint32_t), pairs.size(), in) : pairs.size();
+                used = 0;
+                if (filled < 2) valid = false;
+            }
+            std::string_view ends[2] = {line.substr(0, tab), line.substr(tab + 1)};
+            for (int side = 0; side < 2; side++) {
+                uint64_t h = hash_bytes(ends[side].data(), ends[side].size());
+                if ((h >> 32) % buckets != bucket) continue;
+                uint32_t id = urls.intern(ends[side]);
+                if (id == firsts.size()) firsts.push_back(2 * line_number + side);
+                pairs[used + side] = base + id;
+                if (side == 1) {
+                    if (raw_links.size() <= base + id) raw_links.resize(base + id + 1, 0);
+                    raw_links[base + id]++;
+                }
+            }
+            used += 2;
+            line_number++;
+            if (fit_budget && line_number % 4096 == 0 && urls.memory() + firsts.capacity() * sizeof(uint64_t) > memory_budget / 2) {
+                close();
+                return Interned::OVER_BUDGET;
+            }
+        }
+        valid = valid && fwrite(pairs.data(), sizeof(uint32_t), used, out) == used && !lines.failed();
+        if (!close() || !valid) return Interned::FAILED;
+
+        FILE* bucket_file = fopen(bucketPath(bucket).c_str(), "wb");
+        if (!bucket_file) return Interned::FAILED;
+        for (uint32_t id = 0; id < urls.size() && valid; id++) {
+            std::string_view url = urls.url(id);
+            uint32_t length = (uint32_t) url.size();
+            valid = fwrite(&firsts[id], sizeof(uint64_t), 1, bucket_file) == 1 && fwrite(&length, sizeof(uint32_t), 1, bucket_file) == 1
+                    && fwrite(url.data(), 1, url.size(), bucket_file) == url.size();
+        }
+        valid = fclose(bucket_file) == 0 && valid;
+        count = (uint32_t) urls.size();
+        return valid ? Interned::DONE : Interned::FAILED;
+    }
+
+    // Merges the buckets by first appearance into the URL files, so URL ids come out as a single
+    // pass over the link file would hand them out. ids maps the bucket-numbered ids to them.
+    bool numberUrls(const std::vector<uint32_t>& bucket_bases, std::vector<uint32_t>& ids) {
+        size_t buckets = bucket_bases.size() - 1;
+        ids.assign(bucket_bases.back(), 0);
+        url_path = path("urls");
+        url_index_path = path("urls.index");
+        FILE* url_file = fopen(url_path.c_str(), "wb");
+        FILE* index_file = fopen(url_index_path.c_str(), "wb");
+        std::vector<FILE*> files (buckets);
+        bool valid = url_file && index_file;
+        for (size_t b = 0; b < buckets; b++) {
+            files[b] = fopen(bucketPath(b).c_str(), "rb");
+            if (!files[b]) valid = false;
+        }
+
+        // Heads of the buckets, smallest first appearance on top
+        struct Head {
+            uint64_t first;
+            uint32_t length;
+        };
+        std::vector<Head> heads (buckets);
+        std::vector<uint32_t> next_id (bucket_bases.begin(), bucket_bases.end() - 1);
+        std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t>>, std::greater<>> order;
+        auto advance = [&](uint32_t b) {
+            if (next_id[b] == bucket_bases[b + 1]) return true;
+            if (fread(&heads[b].first, sizeof(uint64_t), 1, files[b]) != 1 || fread(&heads[b].length, sizeof(uint32_t), 1, files[b]) != 1) return false;
+            order.push({heads[b].first, b});
+            return true;
+        };
+        for (uint32_t b = 0; b < buckets && valid; b++) valid = advance(b);
+
+        uint64_t offset = 0;
+        valid = valid && fwrite(&offset, sizeof(uint64_t), 1, index_file) == 1;
+        std::string url;
+        for (uint32_t id = 0; valid && !order.empty(); id++) {
+            uint32_t b = order.top().second;
+            order.pop();
+            url.resize(heads[b].length);
+            valid = fread(&url[0], 1, url.size(), files[b]) == url.size() && fwrite(url.data(), 1, url.size(), url_file) == url.size();
+            offset += url.size();
+            valid = valid && fwrite(&offset, sizeof(uint64_t), 1, index_file) == 1;
+            ids[next_id[b]++] = id;
+            valid = valid && advance(b);
+        }
+        for (size_t b = 0; b < buckets; b++) {
+            if (files[b]) fclose(files[b]);
+            remove(bucketPath(b).c_str());
+        }
+        if (url_file) valid = fclose(url_file) == 0 && valid;
+        if (index_file) valid = fclose(index_file) == 0 && valid;
+        return valid && order.empty();
+    }
+
+    void removeFiles() {
+        for (const Partition& p : partitions) {
+            remove(p.path.c_str());
+            remove((p.path + ".raw").c_str());
+        }
+        if (!url_path.empty()) remove(url_path.c_str());
+        if (!url_index_path.empty()) remove(url_index_path.c_str());
+    }
+
+    public:
+        // Keeps its files in directory, which must exist, and each range's links within memory_budget bytes
+        EdgePartitions(std::string directory, size_t memory_budget)
+            : directory(std::move(directory)), memory_budget(std::max<size_t>(memory_budget, 1 << 16)) {}
+
+        ~EdgePartitions() { removeFiles(); }
+
+        EdgePartitions(const EdgePartitions&) = delete;
+        EdgePartitions& operator=(const EdgePartitions&) = delete;
+
+        // Builds the partitions from a file of "page<TAB>link" lines, skipping lines without a tab.
+        // Returns false if a file could not be read or written in full, a full disk included.
+        bool build(const char* filename) {
+            // Intern the URLs a hash bucket at a time, one pass over the file each, doubling the
+            // buckets until one bucket's URLs fit half the budget
+            std::string spill_path = path("links.spill");
+            std::string next_spill_path = path("links.spill.next");
+            std::vector<uint64_t> raw_links;
+            std::vector<uint32_t> bucket_bases;
+            for (size_t buckets = 1; ; buckets *= 2) {
+                raw_links.clear();
+                bucket_bases.assign(1, 0);
+                Interned result = Interned::DONE;
+                for (size_t b = 0; b < buckets && result == Interned::DONE; b++) {
+                    uint32_t count = 0;
+                    result = internBucket(filename, b, buckets, bucket_bases.back(), buckets < MAX_URL_BUCKETS,
+                                          spill_path, next_spill_path, raw_links, count);
+                    if (result == Interned::DONE && rename(next_spill_path.c_str(), spill_path.c_str()) != 0) result = Interned::FAILED;
+                    bucket_bases.push_back(bucket_bases.back() + count);
+                }
+                url_passes = buckets;
+                if (result == Interned::DONE) break;
+                for (size_t b = 0; b < buckets; b++) remove(bucketPath(b).c_str());
+                remove(next_spill_path.c_str());
+                if (result == Interned::FAILED) {
+                    remove(spill_path.c_str());
+                    return false;
+                }
+            }
+            std::vector<uint32_t> ids;
+            if (!numberUrls(bucket_bases, ids)) {
+                remove(spill_path.c_str());
+                return false;
+            }
+            // Put the inlink counts in URL id order
+            raw_links.resize(ids.size(), 0);
+            inlink_counts.assign(ids.size(), 0);
+            for (size_t i = 0; i < ids.size(); i++) inlink_counts[ids[i]] = (uint32_t) raw_links[i];
+            for (size_t v = 0; v < ids.size(); v++) raw_links[v] = inlink_counts[v];
+
+            // Scatter the links into one raw file per range, the write buffers sharing the budget
+            splitRanges(raw_links);
+            std::vector<uint32_t> range_of (raw_links.size());
+            for (uint32_t r = 0; r < partitions.size(); r++) {
+                std::fill(range_of.begin() + partitions[r].first, range_of.begin() + partitions[r].last, r);
+            }
+            // No buffer is larger than its range's raw links
+            size_t buffer_bytes = std::max<size_t>(4096, memory_budget / 2 / partitions.size());
+            std::vector<FILE*> raw (partitions.size());
+            std::vector<std::vector<char>> buffers (partitions.size());
+            bool opened = true, written = true;
+            for (size_t r = 0; r < partitions.size(); r++) {
+                uint64_t links = 0;
+                for (uint32_t v = partitions[r].first; v < partitions[r].last; v++) links += raw_links[v];
+                buffers[r].resize(std::min<uint64_t>(buffer_bytes, std::max<uint64_t>(4096, 8 * links)));
+                raw[r] = fopen((partitions[r].path + ".raw").c_str(), "wb");
+                if (raw[r]) setvbuf(raw[r], buffers[r].data(), _IOFBF, buffers[r].size());
+                else opened = false;
+            }
+            std::vector<uint64_t>().swap(raw_links);
+            FILE* spill = opened ? fopen(spill_path.c_str(), "rb") : nullptr;
+            std::vector<uint32_t> pairs (1 << 18);
+            if (spill) {
+                size_t read;
+                while (written && (read = fread(pairs.data(), sizeof(uint32_t), pairs.size(), spill)) >= 2) {
+                    for (size_t i = 0; i + 1 < read && written; i += 2) {
+                        uint32_t link[2] = {ids[pairs[i]], ids[pairs[i + 1]]};
+                        written = fwrite(link, sizeof(uint32_t), 2, raw[range_of[link[1]]]) == 2;
+                    }
+                }
+                fclose(spill);
+            }
+            remove(spill_path.c_str());
+            for (FILE* f : raw) if (f && fclose(f) != 0) written = false;
+            if (!opened || !spill || !written) return false;
+            std::vector<uint32_t>().swap(range_of);
+            std::vector<uint32_t>().swap(ids);
+            std::vector<uint32_t>().swap(pairs);
+
+            // Sort and encode the ranges one at a time
+            degrees.assign(inlink_counts.size(), 0);
+            std::vector<uint64_t> sorted;
+            std::vector<uint8_t> out;
+            for (Partition& p : partitions) if (!encode(p, sorted, out)) return false;
+            return true;
+        }
+
+        // Streams partition p through buffer, calling visit(v, sources, count) for every page of its
+        // range in order, with the sorted ids of the pages linking to it. Returns false if the file
+        // could not be read, ends early or holds a count or page id out of range; pages already
+        // visited are not undone.
+        template <class Visit>
+        bool stream(size_t p, std::vector<uint8_t>& buffer, std::vector<uint32_t>& sources, Visit visit) const {
+            FILE* file = fopen(partitions[p].path.c_str(), "rb");
+            if (!file) return false;
+            VarintReader reader (file, buffer);
+            bool valid = true;
+            for (uint32_t v = partitions[p].first; v < partitions[p].last && valid; v++) {
+                // A page has at most one link from each page
+                uint32_t count;
+                if (!reader.next(count) || count > nodes()) {
+                    valid = false;
+                    break;
+                }
+                sources.resize(count);
+                uint64_t source = 0;
+                for (uint32_t i = 0; i < count && valid; i++) {
+                    uint32_t delta;
+                    valid = reader.next(delta) && (source += delta) < nodes();
+                    sources[i] = (uint32_t) source;
+                }
+                if (valid) visit(v, sources.data(), count);
+            }
+            valid = valid && !reader.failed();
+            fclose(file);
+            return valid;
+        }
+
+        // Returns the URL of page id, read back from disk
+        std::string url(uint32_t id) const {
+            std::string url;
+            FILE* index_file = fopen(url_index_path.c_str(), "rb");
+            FILE* url_file = fopen(url_path.c_str(), "rb");
+            uint64_t range[2];
+            if (index_file && url_file && fseek(index_file, (long) id * sizeof(uint64_t), SEEK_SET) == 0
+                && fread(range, sizeof(uint64_t), 2, index_file) == 2 && fseek(url_file, (long) range[0], SEEK_SET) == 0) {
+                url.resize(range[1] - range[0]);
+                url.resize(fread(&url[0], 1, url.size(), url_file));
+            }
+            if (index_file) fclose(index_file);
+            if (url_file) fclose(url_file);
+            return url;
+        }
+
+        // Returns the number of passes over the link file the URLs took, one per hash bucket
+        size_t passes() const { return url_passes; }
+
+        // Returns the number of pages and of distinct links
+        size_t nodes() const { return degrees.size(); }
+        uint64_t edges() const { return link_count; }
+
+        size_t out_degree(uint32_t v) const { return degrees[v]; }
+
+        // Returns the lines of the link file naming each page as the target
+        const std::vector<uint32_t>& inlinks() const { return inlink_counts; }
+
+        // Returns the number of partitions and the pages they start at
+        size_t size() const { return partitions.size(); }
+        uint32_t first_page(size_t p) const { return partitions[p].first; }
+
+        // Returns the bytes of the encoded links on disk
+        uint64_t disk_bytes() const {
+            uint64_t bytes = 0;
+            for (const Partition& p : partitions) bytes += p.bytes;
+            return bytes;
+        }
+
+        // Returns the read buffer to stream with on each of the given number of threads
+        size_t buffer_bytes(int threads) const {
+            uint64_t largest = 0;
+            for (const Partition& p : partitions) largest = std::max(largest, p.bytes);
+            return std::max<size_t>(1 << 16, std::min<uint64_t>(memory_budget / threads, largest + 8));
+        }
+
+        // Frees the inlink counts once they have been reported
+        void release_inlinks() { std::vector<uint32_t>().swap(inlink_counts); }
+};
+
+#endif
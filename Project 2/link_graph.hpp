@@ -0,0 +1,256 @@
+/*
+ * Link graph in compressed sparse row form.
+ * Every URL is interned into a dense 32-bit id, in order of first appearance, with its bytes back
+ * to back in one arena. The out-links of page v are targets[offsets[v], offsets[v + 1]), sorted
+ * and without duplicates, so one PageRank iteration reads the graph as a single linear scan and
+ * rank vectors are flat arrays indexed by id. The transposed adjacency lists the in-links of each
+ * page the same way, for computing ranks by pulling from sources instead of pushing to targets.
+ * Both are built from a list of links with a parallel, stable counting sort.
+ */
+
+#ifndef LINK_GRAPH_HPP
+#define LINK_GRAPH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../common/hash.hpp"
+
+// Open-addressing table from URL to dense id (linear probing, keyed by string_view)
+class UrlTable {
+    std::vector<char> arena;
+    std::vector<uint64_t> offsets = {0};    // URL id starts at offsets[id] and ends at offsets[id + 1]
+    std::vector<uint32_t> slots;            // id + 1, 0 marks an empty slot
+    size_t slot_mask = 0;
+    bool indexed = true;                    // False until the first intern() after assign()
+
+    // Returns the slot holding url, or the empty slot where it belongs
+    size_t findSlot(std::string_view url, uint64_t h) const {
+        size_t slot = h & slot_mask;
+        while (slots[slot] != 0) {
+            uint32_t id = slots[slot] - 1;
+            if (offsets[id + 1] - offsets[id] == url.size() && memcmp(&arena[offsets[id]], url.data(), url.size()) == 0) break;
+            slot = (slot + 1) & slot_mask;
+        }
+        return slot;
+    }
+
+    // Doubles the table and reinserts every id
+    void grow() {
+        std::vector<uint32_t> old_slots;
+        old_slots.swap(slots);
+        slots.assign(old_slots.empty() ? 1024 : old_slots.size() * 2, 0);
+        slot_mask = slots.size() - 1;
+        for (uint32_t entry : old_slots) {
+            if (entry == 0) continue;
+            std::string_view url = this->url(entry - 1);
+            slots[findSlot(url, hash_bytes(url.data(), url.size()))] = entry;
+        }
+    }
+
+    // Builds the table over every id
+    void index() {
+        size_t slot_count = 1024;
+        while (slot_count * 3 < (size() + 1) * 4) slot_count *= 2;
+        slots.assign(slot_count, 0);
+        slot_mask = slot_count - 1;
+        for (uint32_t id = 0; id < size(); id++) {
+            std::string_view url = this->url(id);
+            slots[findSlot(url, hash_bytes(url.data(), url.size()))] = id + 1;
+        }
+        indexed = true;
+    }
+
+    public:
+        // Replaces the contents with URLs already numbered elsewhere: URL id is arena[offsets[id],
+        // offsets[id + 1]). The lookup table is only built if intern() is called later.
+        void assign(std::vector<char> urls, std::vector<uint64_t> url_offsets) {
+            arena = std::move(urls);
+            offsets = std::move(url_offsets);
+            slots.clear();
+            slot_mask = 0;
+            indexed = false;
+        }
+
+        // Returns the id of url, adding it if it is new
+        uint32_t intern(std::string_view url) {
+            if (!indexed) index();
+            // Keep the load factor at or below 3/4
+            if ((size() + 1) * 4 > slots.size() * 3) grow();
+            size_t slot = findSlot(url, hash_bytes(url.data(), url.size()));
+            if (slots[slot] != 0) return slots[slot] - 1;
+
+            uint32_t id = (uint32_t) size();
+            arena.insert(arena.end(), url.begin(), url.end());
+            offsets.push_back(arena.size());
+            slots[slot] = id + 1;
+            return id;
+        }
+
+        // Returns the URL with the given id
+        std::string_view url(uint32_t id) const { return std::string_view(&arena[offsets[id]], offsets[id + 1] - offsets[id]); }
+
+        // Returns the number of distinct URLs
+        size_t size() const { return offsets.size() - 1; }
+
+        // Returns the bytes held by the table
+        size_t memory() const {
+            return arena.capacity() + offsets.capacity() * sizeof(uint64_t) + slots.capacity() * sizeof(uint32_t);
+        }
+};
+
+struct LinkGraph {
+    UrlTable urls;
+    std::vector<uint64_t> offsets = {0};    // Out-links of page v are targets[offsets[v], offsets[v + 1])
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> inlinks;          // Lines of the link file naming each page as the target
+    std::vector<uint64_t> in_offsets;       // In-links of page v come from in_sources[in_offsets[v], in_offsets[v + 1])
+    std::vector<uint32_t> in_sources;
+
+    // Returns the number of pages, every URL seen as either end of a link
+    size_t nodes() const { return urls.size(); }
+
+    // Returns the number of distinct links
+    size_t edges() const { return targets.size(); }
+
+    size_t out_degree(uint32_t v) const { return offsets[v + 1] - offsets[v]; }
+
+    // Returns the bytes held by the graph
+    size_t memory() const {
+        return urls.memory() + (offsets.capacity() + in_offsets.capacity()) * sizeof(uint64_t)
+               + (targets.capacity() + inlinks.capacity() + in_sources.capacity()) * sizeof(uint32_t);
+    }
+};
+
+// Runs work(t) for every thread t in [0, threads), thread 0 being the caller, and waits for all
+template <class Work>
+void run_threads(int threads, Work work) {
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) workers.emplace_back(work, t);
+    work(0);
+    for (std::thread& worker : workers) worker.join();
+}
+
+// Splits the rows of a CSR into one range per thread holding about the same number of items.
+// Range t is [bounds[t], bounds[t + 1]).
+inline std::vector<size_t> split_rows(const std::vector<uint64_t>& offsets, int threads) {
+    size_t rows = offsets.size() - 1;
+    std::vector<size_t> bounds (threads + 1, rows);
+    bounds[0] = 0;
+    for (int t = 1; t < threads; t++) {
+        uint64_t target = offsets.back() * t / threads;
+        size_t row = std::lower_bound(offsets.begin(), offsets.end(), target) - offsets.begin();
+        bounds[t] = std::min(rows, std::max(bounds[t - 1], row));
+    }
+    return bounds;
+}
+
+// Stable parallel counting sort of values by key, each key in [0, n): afterwards the values of key k
+// are grouped[offsets[k], offsets[k + 1]) in input order. Every thread counts and scatters its slice
+// of the input into buckets of consecutive keys, buckets in thread order, then the buckets are
+// sorted by key independently.
+inline void group_by_key(const std::vector<uint32_t>& keys, const std::vector<uint32_t>& values, size_t n, int threads,
+                         std::vector<uint64_t>& offsets, std::vector<uint32_t>& grouped) {
+    size_t count = keys.size();
+    offsets.assign(n + 1, 0);
+    grouped.resize(count);
+    if (n == 0) return;
+    size_t width = (n + 16 * threads - 1) / (16 * threads);
+    size_t buckets = (n + width - 1) / width;
+    auto slice = [&](int t) { return std::make_pair(count * t / threads, count * (t + 1) / threads); };
+
+    // starts[t * buckets + b] is where thread t's items of bucket b go
+    std::vector<uint64_t> starts (threads * buckets, 0);
+    run_threads(threads, [&](int t) {
+        auto [begin, end] = slice(t);
+        for (size_t e = begin; e < end; e++) starts[t * buckets + keys[e] / width]++;
+    });
+    std::vector<uint64_t> bucket_begin (buckets + 1);
+    uint64_t total = 0;
+    for (size_t b = 0; b < buckets; b++) {
+        bucket_begin[b] = total;
+        for (int t = 0; t < threads; t++) total += std::exchange(starts[t * buckets + b], total);
+    }
+    bucket_begin[buckets] = total;
+
+    std::vector<uint32_t> bucket_keys (count), bucket_values (count);
+    run_threads(threads, [&](int t) {
+        auto [begin, end] = slice(t);
+        for (size_t e = begin; e < end; e++) {
+            uint64_t at = starts[t * buckets + keys[e] / width]++;
+            bucket_keys[at] = keys[e];
+            bucket_values[at] = values[e];
+        }
+    });
+
+    // offsets[k + 1] counts key k, then is where its next value goes, which leaves it at the end of k
+    run_threads(threads, [&](int t) {
+        for (size_t b = t; b < buckets; b += threads) {
+            size_t first = b * width, last = std::min(n, first + width);
+            for (uint64_t e = bucket_begin[b]; e < bucket_begin[b + 1]; e++) offsets[bucket_keys[e] + 1]++;
+            uint64_t at = bucket_begin[b];
+            for (size_t k = first; k < last; k++) at += std::exchange(offsets[k + 1], at);
+            for (uint64_t e = bucket_begin[b]; e < bucket_begin[b + 1]; e++) grouped[offsets[bucket_keys[e] + 1]++] = bucket_values[e];
+        }
+    });
+}
+
+// Sorts every row of a CSR and drops its duplicates, compacting items and offsets
+inline void sort_unique_rows(std::vector<uint64_t>& offsets, std::vector<uint32_t>& items, int threads) {
+    std::vector<size_t> bounds = split_rows(offsets, threads);
+    std::vector<uint64_t> lengths (offsets.size() - 1), kept (threads + 1, 0);
+    run_threads(threads, [&](int t) {
+        for (size_t v = bounds[t]; v < bounds[t + 1]; v++) {
+            auto begin = items.begin() + offsets[v], end = items.begin() + offsets[v + 1];
+            std::sort(begin, end);
+            lengths[v] = std::unique(begin, end) - begin;
+            kept[t + 1] += lengths[v];
+        }
+    });
+    for (int t = 0; t < threads; t++) kept[t + 1] += kept[t];
+
+    std::vector<uint32_t> compact (kept[threads]);
+    run_threads(threads, [&](int t) {
+        uint64_t at = kept[t];
+        for (size_t v = bounds[t]; v < bounds[t + 1]; v++) {
+            std::copy(items.begin() + offsets[v], items.begin() + offsets[v] + lengths[v], compact.begin() + at);
+            at += lengths[v];
+        }
+    });
+    // Every row's old start has been read, so the offsets can be rewritten in place
+    run_threads(threads, [&](int t) {
+        uint64_t at = kept[t];
+        for (size_t v = bounds[t]; v < bounds[t + 1]; v++) offsets[v + 1] = at += lengths[v];
+    });
+    items.swap(compact);
+}
+
+// Builds both adjacencies and the inlink counts of graph from parallel arrays of link sources and
+// targets, which may repeat a link. The links are grouped by target first, which gives the inlink
+// counts, duplicates included, and sorted in-link rows once duplicates are dropped. Grouping those
+// by source, in target order, gives sorted out-link rows.
+inline void build_graph(LinkGraph& graph, const std::vector<uint32_t>& sources, const std::vector<uint32_t>& destinations, int threads) {
+    size_t n = graph.nodes();
+    group_by_key(destinations, sources, n, threads, graph.in_offsets, graph.in_sources);
+    graph.inlinks.resize(n);
+    std::vector<size_t> bounds = split_rows(graph.in_offsets, threads);
+    run_threads(threads, [&](int t) {
+        for (size_t v = bounds[t]; v < bounds[t + 1]; v++) graph.inlinks[v] = graph.in_offsets[v + 1] - graph.in_offsets[v];
+    });
+    sort_unique_rows(graph.in_offsets, graph.in_sources, threads);
+
+    std::vector<uint32_t> in_targets (graph.in_sources.size());
+    bounds = split_rows(graph.in_offsets, threads);
+    run_threads(threads, [&](int t) {
+        for (size_t v = bounds[t]; v < bounds[t + 1]; v++) {
+            std::fill(in_targets.begin() + graph.in_offsets[v], in_targets.begin() + graph.in_offsets[v + 1], (uint32_t) v);
+        }
+    });
+    group_by_key(graph.in_sources, in_targets, n, threads, graph.offsets, graph.targets);
+}
+
+#endif
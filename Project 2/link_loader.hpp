@@ -0,0 +1,193 @@
+/*
+ * Parallel loader for link files of "page<TAB>link" lines.
+ * The file is memory-mapped and cut into one chunk per thread at line boundaries. Each thread splits
+ * its lines at the tab and interns both URLs into a table sharded by hash, each shard behind its own
+ * lock, so threads rarely wait on one another. URL ids are then handed out in order of first
+ * appearance in the file, exactly as a sequential loader would, and the link list is turned into
+ * the graph's adjacencies by build_graph().
+ */
+
+#ifndef LINK_LOADER_HPP
+#define LINK_LOADER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "../common/mapped_file.hpp"
+#include "link_graph.hpp"
+
+// URL table for several threads at once: 256 shards picked by the top bits of the hash, each an
+// open-addressing table of entries viewing into the mapped file, with the high half of each URL's
+// hash kept beside its index. A URL is known by a handle, its shard in the high 32 bits and its
+// index there in the low 32.
+class ConcurrentUrlTable {
+    public:
+        struct Entry {
+            const char* data;
+            uint32_t length;
+            uint32_t id;
+            uint64_t first;     // Smallest order any thread interned the URL with
+        };
+
+    private:
+        static constexpr int SHARD_BITS = 8;
+
+        struct alignas(64) Shard {
+            std::mutex lock;
+            std::vector<Entry> entries;
+            std::vector<uint64_t> slots;    // High half of the hash, then entry index + 1; 0 marks an empty slot
+            size_t slot_mask = 0;
+        };
+
+        std::vector<Shard> shards;
+
+        // Returns the slot of shard holding url, or the empty slot where it belongs
+        static size_t findSlot(const Shard& shard, std::string_view url, uint64_t h) {
+            size_t slot = h & shard.slot_mask;
+            while (shard.slots[slot] != 0) {
+                // The hash kept in the slot rules out most other URLs without touching their entry
+                const Entry& entry = shard.entries[(uint32_t) shard.slots[slot] - 1];
+                if (shard.slots[slot] >> 32 == h >> 32 && entry.length == url.size() && memcmp(entry.data, url.data(), url.size()) == 0) break;
+                slot = (slot + 1) & shard.slot_mask;
+            }
+            return slot;
+        }
+
+        // Doubles the table of shard and reinserts every entry
+        static void grow(Shard& shard) {
+            shard.slots.assign(shard.slots.empty() ? 256 : shard.slots.size() * 2, 0);
+            shard.slot_mask = shard.slots.size() - 1;
+            for (uint32_t i = 0; i < shard.entries.size(); i++) {
+                std::string_view url (shard.entries[i].data, shard.entries[i].length);
+                uint64_t h = hash_bytes(url.data(), url.size());
+                shard.slots[findSlot(shard, url, h)] = (h >> 32 << 32) | (i + 1);
+            }
+        }
+
+    public:
+        ConcurrentUrlTable() : shards(1 << SHARD_BITS) {}
+
+        // Returns the handle of url, which must outlive the table, adding it if it is new. order
+        // places this occurrence in the file; the entry keeps the smallest one seen.
+        uint64_t intern(std::string_view url, uint64_t order) {
+            uint64_t h = hash_bytes(url.data(), url.size());
+            uint64_t s = h >> (64 - SHARD_BITS);
+            Shard& shard = shards[s];
+            std::lock_guard<std::mutex> guard (shard.lock);
+            // Keep the load factor at or below 3/4
+            if ((shard.entries.size() + 1) * 4 > shard.slots.size() * 3) grow(shard);
+            size_t slot = findSlot(shard, url, h);
+            if (shard.slots[slot] == 0) {
+                shard.entries.push_back(Entry {url.data(), (uint32_t) url.size(), 0, order});
+                shard.slots[slot] = (h >> 32 << 32) | shard.entries.size();
+            }
+            uint32_t index = (uint32_t) shard.slots[slot] - 1;
+            Entry& entry = shard.entries[index];
+            if (order < entry.first) entry.first = order;
+            return s << 32 | index;
+        }
+
+        // Returns the entry of a handle; only safe once every intern() is done
+        Entry& entry(uint64_t handle) { return shards[handle >> 32].entries[(uint32_t) handle]; }
+};
+
+// Reads a file of "page<TAB>link" lines into graph on the given number of threads. Lines without a
+// tab are skipped. Returns false if the file could not be opened.
+inline bool load_links(const char* filename, LinkGraph& graph, int threads) {
+    MappedFile file (filename);
+    if (!file.is_open()) return false;
+    std::string_view text = file.view();
+
+    // Chunk t is text[bounds[t], bounds[t + 1]), each ending just after a newline
+    std::vector<size_t> bounds (threads + 1, text.size());
+    bounds[0] = 0;
+    for (int t = 1; t < threads; t++) {
+        size_t at = std::max(bounds[t - 1], text.size() * t / threads);
+        const char* newline = at == 0 ? nullptr : (const char*) memchr(text.data() + at - 1, '\n', text.size() - at + 1);
+        bounds[t] = newline ? newline + 1 - text.data() : text.size();
+    }
+
+    // Intern both ends of every link. Thread t's i-th URL has order t << 40 | i, so orders follow
+    // the file; handles holds the page and link of each line in turn.
+    ConcurrentUrlTable urls;
+    std::vector<std::vector<uint64_t>> handles (threads);
+    run_threads(threads, [&](int t) {
+        const char* at = text.data() + bounds[t];
+        const char* end = text.data() + bounds[t + 1];
+        uint64_t order = (uint64_t) t << 40;
+        std::string_view last_page;
+        uint64_t last_handle = 0;
+        while (at < end) {
+            const char* newline = (const char*) memchr(at, '\n', end - at);
+            const char* line_end = newline ? newline : end;
+            const char* tab = (const char*) memchr(at, '\t', line_end - at);
+            if (tab) {
+                // Sorted link files give one page many lines in a row, only the first needs a lookup
+                std::string_view page (at, tab - at);
+                if (handles[t].empty() || page != last_page) {
+                    last_handle = urls.intern(page, order);
+                    last_page = page;
+                }
+                handles[t].push_back(last_handle);
+                order++;
+                handles[t].push_back(urls.intern(std::string_view(tab + 1, line_end - tab - 1), order++));
+            }
+            at = line_end + 1;
+        }
+    });
+
+    // A URL gets its id where it first appears: counting those firsts per chunk gives each chunk its
+    // first id and its first byte in the URL arena
+    std::vector<uint64_t> id_base (threads + 1, 0), byte_base (threads + 1, 0), edge_base (threads + 1, 0);
+    run_threads(threads, [&](int t) {
+        uint64_t order = (uint64_t) t << 40;
+        for (uint64_t handle : handles[t]) {
+            const ConcurrentUrlTable::Entry& entry = urls.entry(handle);
+            if (entry.first == order++) {
+                id_base[t + 1]++;
+                byte_base[t + 1] += entry.length;
+            }
+        }
+        edge_base[t + 1] = handles[t].size() / 2;
+    });
+    for (int t = 0; t < threads; t++) {
+        id_base[t + 1] += id_base[t];
+        byte_base[t + 1] += byte_base[t];
+        edge_base[t + 1] += edge_base[t];
+    }
+
+    std::vector<char> arena (byte_base[threads]);
+    std::vector<uint64_t> offsets (id_base[threads] + 1, 0);
+    run_threads(threads, [&](int t) {
+        uint64_t order = (uint64_t) t << 40;
+        uint32_t id = (uint32_t) id_base[t];
+        uint64_t at = byte_base[t];
+        for (uint64_t handle : handles[t]) {
+            ConcurrentUrlTable::Entry& entry = urls.entry(handle);
+            if (entry.first != order++) continue;
+            entry.id = id;
+            memcpy(&arena[at], entry.data, entry.length);
+            at += entry.length;
+            offsets[++id] = at;
+        }
+    });
+
+    // Number the links, each chunk's after the chunks before it
+    std::vector<uint32_t> sources (edge_base[threads]), destinations (edge_base[threads]);
+    run_threads(threads, [&](int t) {
+        uint64_t e = edge_base[t];
+        for (size_t i = 0; i < handles[t].size(); i += 2, e++) {
+            sources[e] = urls.entry(handles[t][i]).id;
+            destinations[e] = urls.entry(handles[t][i + 1]).id;
+        }
+        std::vector<uint64_t>().swap(handles[t]);
+    });
+
+    graph.urls.assign(std::move(arena), std::move(offsets));
+    build_graph(graph, sources, destinations, threads);
+    return true;
+}
+
+#endif
@@ -1,139 +1,456 @@
 /*
+ * Build: g++ -std=c++17 -O2 -pthread pagerank.cpp -o pagerank
+ *
+ * Citations:
  * https://www.geeksforgeeks.org/sorting-a-map-by-value-in-c-stl/
  * https://stackoverflow.com/questions/11315854/input-from-command-line
  */
 
 #include <iostream>
 #include <fstream>
-#include <unordered_map>
-#include <set>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <filesystem>
+#include "edge_partitions.hpp"
 
 using namespace std;
 
-// Inlink Data Structures
-unordered_map<string, double> inlinks;
+// Returns the ids of the (at most) limit pages with the highest values, highest first, ties in id order
+template <class T>
+vector<uint32_t> topPages(const vector<T>& values, size_t limit, bool skip_zero) {
+    vector<uint32_t> ids;
+    for (uint32_t v = 0; v < values.size(); v++) if (!skip_zero || values[v] != 0) ids.push_back(v);
+    limit = std::min(limit, ids.size());
+    partial_sort(ids.begin(), ids.begin() + limit, ids.end(), [&](uint32_t a, uint32_t b) {
+        return values[a] != values[b] ? values[a] > values[b] : a < b;
+    });
+    ids.resize(limit);
+    return ids;
+}
+
+// Per-thread sums of an iteration, each on its own cache line
+struct alignas(64) PartialSums {
+    double dangling = 0;
+    double norm = 0;
+    double total = 0;
+};
+
+// Splits the pages into one range per thread with about the same number of in-links plus pages
+// each, the boundaries on multiples of 8 so no two threads write to one 64-byte line of a vector
+// of doubles. Range t is [bounds[t], bounds[t + 1]).
+vector<uint32_t> splitPages(const LinkGraph& graph, int threads) {
+    size_t n = graph.nodes();
+    double work = (double) graph.edges() + n;
+    vector<uint32_t> bounds (threads + 1, (uint32_t) n);
+    bounds[0] = 0;
+    uint32_t v = 0;
+    for (int t = 1; t < threads; t++) {
+        double target = work * t / threads;
+        while (v < n && graph.in_offsets[v] + v < target) v++;
+        v = std::max(bounds[t - 1], (uint32_t) std::min<size_t>(n, (v + 7) & ~(size_t) 7));
+        bounds[t] = v;
+    }
+    return bounds;
+}
+
+// Pull-based power iteration: each thread computes the new rank of every page in its range from
+// the shares of the pages linking to it, reading the last iteration and writing only its own range,
+// so no atomics are needed. A page's share, I[p] / out-degree, is prepared by its owner as its rank
+// is computed. Iterates until the L1 distance between two iterations falls below tau, or for
+// max_iterations, and returns the number of iterations; the ranks end in I.
+int pullIteration(const LinkGraph& graph, double lambda, double tau, int max_iterations, int threads, vector<double>& I) {
+    size_t n = graph.nodes();
+    I.assign(n, 1.0 / n);
+    vector<double> R (n), share (n), next_share (n);
+    vector<uint32_t> bounds = splitPages(graph, threads);
+    vector<PartialSums> sums (threads);
+
+    double dangling = 0;
+    for (uint32_t p = 0; p < n; p++) {
+        if (graph.out_degree(p) == 0) dangling += I[p];
+        else share[p] = I[p] / graph.out_degree(p);
+    }
+
+    int iterations = 0;
+    double norm;
+    do {
+        // Random surfer plus the rank of pages with no outlinks, spread over every page
+        double base = lambda / n + (1 - lambda) * dangling / n;
+        run_threads(threads, [&](int t) {
+            PartialSums local;
+            for (uint32_t v = bounds[t]; v < bounds[t + 1]; v++) {
+                double sum = 0;
+                for (uint64_t e = graph.in_offsets[v]; e < graph.in_offsets[v + 1]; e++) sum += share[graph.in_sources[e]];
+                double rank = base + (1 - lambda) * sum;
+                R[v] = rank;
+                local.norm += abs(rank - I[v]);
+                size_t degree = graph.out_degree(v);
+                if (degree == 0) {
+                    next_share[v] = 0;
+                    local.dangling += rank;
+                }
+                else next_share[v] = rank / degree;
+            }
+            sums[t] = local;
+        });
+
+        dangling = norm = 0;
+        for (const PartialSums& partial : sums) {
+            dangling += partial.dangling;
+            norm += partial.norm;
+        }
+        I.swap(R);
+        share.swap(next_share);
+        iterations++;
+    } while (norm >= tau && iterations < max_iterations);
+    return iterations;
+}
+
+// Shares read while other threads write them are relaxed atomics, plain doubles on one thread
+inline double loadShare(const double& share) { return share; }
+inline double loadShare(const atomic<double>& share) { return share.load(memory_order_relaxed); }
+inline void storeShare(double& share, double value) { share = value; }
+inline void storeShare(atomic<double>& share, double value) { share.store(value, memory_order_relaxed); }
+
+// Gauss-Seidel (one thread, Share = double) or asynchronous (several, Share = atomic<double>)
+// iteration: ranks and shares are updated in place, so every page is computed from the freshest
+// ranks of the pages linking to it, including those updated earlier in the same sweep. The threads
+// own page ranges as in pullIteration() but read the shares other threads are writing at the same
+// time. Each thread keeps the rank of its pages with no outlinks as a running
+// total, added up between sweeps. Updating in place does not keep the ranks summing to 1, so they
+// are rescaled after every sweep; without that the total converges more slowly than the ranks.
+// Sweeps until the L1 change made by one falls below tau, or max_iterations times, and returns the
+// number of sweeps; the ranks end in I.
+template <class Share>
+int inPlaceIteration(const LinkGraph& graph, double lambda, double tau, int max_iterations, int threads, vector<double>& I) {
+    size_t n = graph.nodes();
+    I.assign(n, 1.0 / n);
+    unique_ptr<Share[]> share (new Share[n]);
+    vector<uint32_t> bounds = splitPages(graph, threads);
+    vector<PartialSums> sums (threads);
+
+    for (int t = 0; t < threads; t++) {
+        for (uint32_t p = bounds[t]; p < bounds[t + 1]; p++) {
+            if (graph.out_degree(p) == 0) sums[t].dangling += I[p];
+            storeShare(share[p], graph.out_degree(p) == 0 ? 0 : I[p] / graph.out_degree(p));
+        }
+    }
+
+    int iterations = 0;
+    double norm;
+    do {
+        double dangling = 0;
+        for (const PartialSums& partial : sums) dangling += partial.dangling;
+        run_threads(threads, [&](int t) {
+            // The rank of this range's dangling pages is current, the rest as of the last sweep
+            double other_dangling = dangling - sums[t].dangling;
+            PartialSums local;
+            local.dangling = sums[t].dangling;
+            for (uint32_t v = bounds[t]; v < bounds[t + 1]; v++) {
+                double sum = 0;
+                for (uint64_t e = graph.in_offsets[v]; e < graph.in_offsets[v + 1]; e++) {
+                    sum += loadShare(share[graph.in_sources[e]]);
+                }
+                double rank = lambda / n + (1 - lambda) * ((other_dangling + local.dangling) / n + sum);
+                local.norm += abs(rank - I[v]);
+                local.total += rank;
+                size_t degree = graph.out_degree(v);
+                if (degree == 0) local.dangling += rank - I[v];
+                else storeShare(share[v], rank / degree);
+                I[v] = rank;
+            }
+            sums[t] = local;
+        });
+
+        double total = 0;
+        norm = 0;
+        for (const PartialSums& partial : sums) {
+            total += partial.total;
+            norm += partial.norm;
+        }
+        run_threads(threads, [&](int t) {
+            for (uint32_t v = bounds[t]; v < bounds[t + 1]; v++) {
+                I[v] /= total;
+                storeShare(share[v], loadShare(share[v]) / total);
+            }
+            sums[t].dangling /= total;
+        });
+        iterations++;
+    } while (norm >= tau && iterations < max_iterations);
+    return iterations;
+}
+
+// Returns the L1 distance between ranks and one power iteration step from them
+double residual(const LinkGraph& graph, double lambda, const vector<double>& ranks) {
+    size_t n = graph.nodes();
+    double dangling = 0;
+    for (uint32_t p = 0; p < n; p++) if (graph.out_degree(p) == 0) dangling += ranks[p];
+    double distance = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        double sum = 0;
+        for (uint64_t e = graph.in_offsets[v]; e < graph.in_offsets[v + 1]; e++) {
+            uint32_t u = graph.in_sources[e];
+            sum += ranks[u] / graph.out_degree(u);
+        }
+        distance += abs(lambda / n + (1 - lambda) * (dangling / n + sum) - ranks[v]);
+    }
+    return distance;
+}
 
-// PageRank Data Structures
-unordered_map<string, set<string>> graph;           // Graph G in pseudocode
-unordered_map<string, double> I;                    // Vector I in pseudocode
-unordered_map<string, double> R;                    // Vector R in pseudocode
-int norm = 0;
+// Pull-based power iteration over links kept on disk: every iteration streams each partition once,
+// threads taking the partitions in turn, and only per-page vectors live in memory. The arithmetic is
+// that of pullIteration(), so the ranks come out the same. Returns the number of iterations, or -1
+// if a partition could not be read.
+int externalIteration(const EdgePartitions& graph, double lambda, double tau, int max_iterations, int threads, vector<double>& I) {
+    size_t n = graph.nodes();
+    I.assign(n, 1.0 / n);
+    vector<double> R (n), share (n), next_share (n);
+    vector<PartialSums> sums (threads);
+    vector<vector<uint8_t>> buffers (threads, vector<uint8_t>(graph.buffer_bytes(threads)));
+    vector<vector<uint32_t>> sources (threads);
+    vector<char> failed (threads, 0);
 
+    double dangling = 0;
+    for (uint32_t p = 0; p < n; p++) {
+        if (graph.out_degree(p) == 0) dangling += I[p];
+        else share[p] = I[p] / graph.out_degree(p);
+    }
 
-bool cmp(pair<string, double> a, pair<string, double> b) {
-    return a.second > b.second;
+    int iterations = 0;
+    double norm;
+    do {
+        double base = lambda / n + (1 - lambda) * dangling / n;
+        run_threads(threads, [&](int t) {
+            PartialSums local;
+            for (size_t p = t; p < graph.size(); p += threads) {
+                bool streamed = graph.stream(p, buffers[t], sources[t], [&](uint32_t v, const uint32_t* from, uint32_t count) {
+                    double sum = 0;
+                    for (uint32_t i = 0; i < count; i++) sum += share[from[i]];
+                    double rank = base + (1 - lambda) * sum;
+                    R[v] = rank;
+                    local.norm += abs(rank - I[v]);
+                    size_t degree = graph.out_degree(v);
+                    if (degree == 0) {
+                        next_share[v] = 0;
+                        local.dangling += rank;
+                    }
+                    else next_share[v] = rank / degree;
+                });
+                if (!streamed) failed[t] = 1;
+            }
+            sums[t] = local;
+        });
+        if (count(failed.begin(), failed.end(), 1) > 0) return -1;
+
+        dangling = norm = 0;
+        for (const PartialSums& partial : sums) {
+            dangling += partial.dangling;
+            norm += partial.norm;
+        }
+        I.swap(R);
+        share.swap(next_share);
+        iterations++;
+    } while (norm >= tau && iterations < max_iterations);
+    return iterations;
 }
 
-vector<pair<string, double>> mapSort(unordered_map<string, double>& map) {
-    vector<pair<string, double>> ret;
-    for (auto& it : map) {
-        ret.push_back(pair<string, double>(it.first, it.second));
+// Computes PageRank with the links on disk in directory, as partitions of at most memory_budget
+// bytes, and writes inlink.txt and pagerank.txt like the in-memory run
+int runOutOfCore(const char* filename, double lambda, double tau, int max_iterations, int threads, const string& directory, size_t memory_budget) {
+    std::error_code error;
+    filesystem::create_directories(directory, error);
+    auto start = chrono::steady_clock::now();
+    EdgePartitions graph (directory, memory_budget);
+    if (!graph.build(filename)) {
+        cout << "Could not read " << filename << " or write the link partitions to " << directory << endl;
+        return -1;
+    }
+    if (graph.nodes() == 0) {
+        cout << "No links in " << filename << endl;
+        return -1;
+    }
+    double build_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream inlink("inlink.txt");
+    vector<uint32_t> inlink_ranks = topPages(graph.inlinks(), 75, true);
+    for (size_t i = 0; i < inlink_ranks.size(); i++) {
+        uint32_t v = inlink_ranks[i];
+        inlink << graph.url(v) << " " << i + 1 << " " << graph.inlinks()[v] << endl;
+    }
+    inlink.close();
+    graph.release_inlinks();
+
+    start = chrono::steady_clock::now();
+    vector<double> ranks;
+    int iterations = externalIteration(graph, lambda, tau, max_iterations, threads, ranks);
+    if (iterations < 0) {
+        cout << "Could not read the link partitions in " << directory << endl;
+        return -1;
     }
+    double rank_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream pagerank_output ("pagerank.txt");
+    vector<uint32_t> pagerank = topPages(ranks, 75, false);
+    for (size_t i = 0; i < pagerank.size(); i++) {
+        uint32_t v = pagerank[i];
+        pagerank_output << graph.url(v) << " " << i + 1 << " " << ranks[v] << endl;
+    }
+    pagerank_output.close();
 
-    sort(ret.begin(), ret.end(), cmp);
-    return ret;
+    size_t vector_bytes = graph.nodes() * (4 * sizeof(double) + sizeof(uint32_t));
+    cout << graph.nodes() << " pages, " << graph.edges() << " links in " << graph.size() << " partitions ("
+         << graph.disk_bytes() / (1 << 20) << " MB on disk), built in " << build_seconds << " s with "
+         << graph.passes() << " URL passes" << endl;
+    cout << "out of core: " << iterations << " iterations in " << rank_seconds << " s on " << threads << " threads, "
+         << vector_bytes / (1 << 20) << " MB of rank vectors and degrees, " << (double) graph.buffer_bytes(threads) * threads / (1 << 20)
+         << " MB of read buffers" << endl;
+    if (iterations == max_iterations) cout << "stopped at the cap of " << max_iterations << " iterations" << endl;
+    return 0;
+}
+
+enum class Solver { JACOBI, GAUSS_SEIDEL, ASYNC };
+
+const char* solverName(Solver solver) {
+    return solver == Solver::JACOBI ? "jacobi" : solver == Solver::GAUSS_SEIDEL ? "gauss-seidel" : "async";
+}
+
+// Runs the chosen solver, Gauss-Seidel always on one thread, and returns its number of iterations
+int solve(const LinkGraph& graph, double lambda, double tau, int max_iterations, Solver solver, int threads, vector<double>& ranks) {
+    if (solver == Solver::JACOBI) return pullIteration(graph, lambda, tau, max_iterations, threads, ranks);
+    if (solver == Solver::GAUSS_SEIDEL || threads == 1) return inPlaceIteration<double>(graph, lambda, tau, max_iterations, 1, ranks);
+    return inPlaceIteration<atomic<double>>(graph, lambda, tau, max_iterations, threads, ranks);
+}
+
+// Times solve() on 1, 2, 4, ... 64 threads and prints the speedup over one thread and the
+// largest difference from its ranks
+void reportScaling(const LinkGraph& graph, double lambda, double tau, int max_iterations, Solver solver) {
+    vector<double> single;
+    double single_seconds = 0;
+    cout << "threads\titerations\tseconds\tms/iteration\tspeedup\tmax difference" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        vector<double> ranks;
+        auto start = chrono::steady_clock::now();
+        int iterations = solve(graph, lambda, tau, max_iterations, solver, threads, ranks);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (threads == 1) {
+            single.swap(ranks);
+            single_seconds = seconds;
+        }
+        double difference = 0;
+        for (size_t v = 0; v < ranks.size(); v++) difference = std::max(difference, abs(ranks[v] - single[v]));
+        cout << threads << "\t" << iterations << "\t" << seconds << "\t" << 1000 * seconds / iterations << "\t"
+             << single_seconds / seconds << "\t" << difference << endl;
+    }
 }
 
-int min(int a, int b) {
-    if (a < b) return a;
-    return b;
+// Prints the command line usage
+void printUsage() {
+    cout << "To run: ./pagerank links.srt (double)lambda (double)tau [-j threads] [-solver name] [-scaling]" << endl;
+    cout << "                  [-max-iterations count] [-out-of-core directory] [-memory bytes]" << endl;
+    cout << "links.srt holds one 'page<TAB>link' line per link; lambda is the random jump probability and" << endl;
+    cout << "    iteration stops once the L1 change of the ranks is below tau" << endl;
+    cout << "'-max-iterations' stops iterating after the given number of iterations even if tau is not reached (default 1000)" << endl;
+    cout << "'-j' loads the links and computes the ranks on the given number of threads (default 1)" << endl;
+    cout << "'-solver' picks 'jacobi' (power iteration, the default), 'gauss-seidel' (in place on one thread, using" << endl;
+    cout << "    the freshest ranks) or 'async' (in place on '-j' threads that read each other's ranks as they change)" << endl;
+    cout << "'-scaling' also times the solver on 1 to 64 threads and prints the speedups" << endl;
+    cout << "'-out-of-core' keeps the links on disk in the given directory, partitioned by target page, and streams" << endl;
+    cout << "    them once per power iteration; the rank vectors and up to 20 bytes a page of build arrays stay in memory" << endl;
+    cout << "    (only the 'jacobi' solver runs out of core)" << endl;
+    cout << "'-memory' bounds the URLs and links held in memory at once out of core (default 256 MB): the URLs are" << endl;
+    cout << "    interned in as many hash buckets as fit it, each partition is sorted within it and the read buffers share it" << endl;
 }
 
 int main(int argc, char** argv) {
-    if (argc < 2) cout << "To run: ./pagerank links.srt (double)lambda (double)tau" << endl;
+    if (argc < 4) {
+        printUsage();
+        return -1;
+    }
 
     // Get command line arguments
     const char* filename = (const char*) argv[1];
     double lambda = atof(argv[2]);
     double tau = atof(argv[3]);
+    int max_iterations = 1000;
+    int threads = 1;
+    bool scaling = false;
+    Solver solver = Solver::JACOBI;
+    string out_of_core;
+    size_t memory_budget = (size_t) 256 << 20;
+    for (int i = 4; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "-max-iterations" && i + 1 < argc) max_iterations = std::max(1, atoi(argv[++i]));
+        else if (arg == "-scaling") scaling = true;
+        else if (arg == "-out-of-core" && i + 1 < argc) out_of_core = argv[++i];
+        else if (arg == "-memory" && i + 1 < argc) memory_budget = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-solver" && i + 1 < argc) {
+            string name = argv[++i];
+            if (name == "gauss-seidel") solver = Solver::GAUSS_SEIDEL;
+            else if (name == "async") solver = Solver::ASYNC;
+            else if (name == "jacobi") solver = Solver::JACOBI;
+            else {
+                cout << "Unknown solver " << name << endl;
+                printUsage();
+                return -1;
+            }
+        }
+    }
+    if (!out_of_core.empty() && solver != Solver::JACOBI) {
+        cout << "'-out-of-core' only runs the 'jacobi' solver" << endl;
+        return -1;
+    }
 
-    // Read links from file
-    ifstream input_stream (filename);
-    string line, page, link;
-    while (getline(input_stream, line, '\n')) {
-        int mid = line.find('\t');
-        page = line.substr(0, mid);
-        link = line.substr(mid + 1);
-
-        // Put into inlink map
-        if (inlinks.count(link) == 0) inlinks.insert(pair<string, int>(link, 1));
-        else inlinks[link]++;
-
-        // Put source into PageRank graph
-        if (graph.count(page) == 0) graph.insert(pair<string, set<string>>(page, set<string>{link}));
-        else graph[page].insert(link);
-
-        // Put target into PageRank graph
-        if (graph.count(link) == 0) graph.insert(pair<string, set<string>>(link, set<string>{}));
+    if (!out_of_core.empty()) return runOutOfCore(filename, lambda, tau, max_iterations, threads, out_of_core, memory_budget);
 
+    // Read links from file into the link graph
+    auto start = chrono::steady_clock::now();
+    LinkGraph graph;
+    if (!load_links(filename, graph, threads)) {
+        cout << "Could not open " << filename << endl;
+        return -1;
     }
-    input_stream.close();
+    if (graph.nodes() == 0) {
+        cout << "No links in " << filename << endl;
+        return -1;
+    }
+    double load_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
 
     // Print top 75 pages ranked by inlinks to file "inlink.txt"
     ofstream inlink("inlink.txt");
-    vector<pair<string, double>> inlink_ranks = mapSort(inlinks);
-    int limit = min(inlinks.size(), 75);
-    for (int i = 0; i < limit; i++) {
-        inlink << inlink_ranks[i].first << " " << i + 1 << " " << inlink_ranks[i].second << endl;
+    vector<uint32_t> inlink_ranks = topPages(graph.inlinks, 75, true);
+    for (size_t i = 0; i < inlink_ranks.size(); i++) {
+        uint32_t v = inlink_ranks[i];
+        inlink << graph.urls.url(v) << " " << i + 1 << " " << graph.inlinks[v] << endl;
     }
     inlink.close();
 
 
     // Calculating PageRank
-    // Put every page into I & R
-    for (auto& it : graph) {
-        I[it.first] = 0;
-        R[it.first] = 0;
-    }
-
-    // Set initial likelihood of being on each page
-    for (auto& it : I) I[it.first] = 1.0/graph.size();
-
-    // While not converged, update PageRanks
-    while (norm < tau) {
-        // Accumulator
-        double to_add = 0;
-
-        // Account for random surfer
-        for (auto& it: graph) R[it.first] = lambda/graph.size();
-
-        // Adjust target page pageranks
-        // Add to accumulator for pages with no outlinks
-        for (auto& it : graph) {
-            if (it.second.size() > 0) {
-                set<string> targets = it.second;
-                for (auto& q : targets) {
-                    // Add probability of coming to this page from previous page
-                    R[q] += (1 - lambda) * I[q]/targets.size();
-                }
-            } else {
-                // Accumulating sum of probabilities for pages w/ no outlinks
-                to_add += (1 - lambda) * I[it.first]/graph.size();
-            }
-        }
-
-        // Adding probability of being on page with no outlink
-        // Calculating norm
-        // Setting I = R for next iteration
-        for (auto& it : graph) {
-            R[it.first] += to_add;
-            norm += abs(I[it.first] - R[it.first]);
-            I[it.first] = R[it.first];
-        }
-    }
+    start = chrono::steady_clock::now();
+    vector<double> ranks;
+    int iterations = solve(graph, lambda, tau, max_iterations, solver, threads, ranks);
+    double rank_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
     ofstream pagerank_output ("pagerank.txt");
-    vector<pair<string, double>> pagerank = mapSort(R);
-    limit = min(pagerank.size(), 75);
-    for (int i = 0; i < limit; i++) {
-        pagerank_output << pagerank[i].first << " " << i + 1 << " " << pagerank[i].second << endl;
+    vector<uint32_t> pagerank = topPages(ranks, 75, false);
+    for (size_t i = 0; i < pagerank.size(); i++) {
+        uint32_t v = pagerank[i];
+        pagerank_output << graph.urls.url(v) << " " << i + 1 << " " << ranks[v] << endl;
     }
     pagerank_output.close();
 
+    cout << graph.nodes() << " pages, " << graph.edges() << " links (" << graph.memory() / (1 << 20) << " MB), loaded in "
+         << load_seconds << " s" << endl;
+    if (solver == Solver::GAUSS_SEIDEL) threads = 1;
+    cout << solverName(solver) << ": " << iterations << " iterations in " << rank_seconds << " s on " << threads
+         << " threads, L1 residual " << residual(graph, lambda, ranks) << endl;
+    if (iterations == max_iterations) cout << "stopped at the cap of " << max_iterations << " iterations" << endl;
+    if (scaling) reportScaling(graph, lambda, tau, max_iterations, solver);
     return 0;
 }
-
-
@@ -1,4 +1,7 @@
-/* Citations:
+/*
+ * Build: g++ -std=c++17 -O2 -pthread indexer.cpp -o indexer -lz
+ *
+ * Citations:
  * https://stackoverflow.com/questions/3450860/check-if-a-stdvector-contains-a-certain-object
  */
 
@@ -9,6 +12,9 @@
 #include <unordered_set>
 #include <set>
 #include "nlohmann/json.hpp"
+#include "../common/analyzer.hpp"
+#include "../common/gzip_reader.hpp"
+#include "../common/stemmer.hpp"
 
 
 // Avoiding use of `using namespace std;`
@@ -20,6 +26,10 @@ using std::pair;
 using std::cout;
 using std::endl;
 
+// Terms are whitespace- and punctuation-delimited, abbreviation-folded and lowercased, for the
+// collection and the queries alike. With -stem they are also stemmed, a document or query at a time.
+using TermAnalyzer = Analyzer<true, true, NoStopwords, NoStemming>;
+
 
 // Postings Class to store postings list
 class Postings {
@@ -48,6 +58,10 @@ class Postings {
 // Maps inverted_list[term] = Postings
 unordered_map<string, Postings*> inverted_list;
 
+// Set by -stem: terms are stemmed, through one reused batch
+bool use_stemming = false;
+StemBatch stem_buffer;
+
 // Vector with docId as indices => doc_info[docId] = pair<sceneId, playId>
 vector<pair<string, string>> doc_info;
 
@@ -121,15 +135,25 @@ string get_playId(int docId) { return doc_info[docId].second; }
 // Returns the sceneId given the docId
 string get_sceneId(int docId) { return doc_info[docId].first; }
 
+// Returns the terms of a query, normalized the same way as the collection
+vector<string> analyze_query(const string& query) {
+    vector<string> terms;
+    TermAnalyzer analyzer (query);
+    Token token;
+    while (analyzer.next(token)) terms.emplace_back(token.term);
+    return terms;
+}
+
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        cout << "Usage: ./indexer <file.json> [-play] [-gt] [-phrase] queries" << endl;
+        cout << "Usage: ./indexer <file.json[.gz]> [-play] [-gt] [-phrase] [-stem] queries" << endl;
         cout << "Default: Returns sceneId's and assumes all arguments are independent terms" << endl;
         cout << "To return a play, use the '-play' flag" << endl;
         cout << "To search for a phrase, use the '-phrase' flag" << endl;
         cout << "To do term frequency comparisons, use the '-gt' flag, and separate larger terms with '-gt'" << endl;
         cout << "N.B. The '-gt' flag cannot be used in conjunction with other flags" << endl;
+        cout << "To stem the collection and the queries, use the '-stem' flag" << endl;
         exit(-1);
     }
 
@@ -147,11 +171,22 @@ int main(int argc, char **argv) {
             is_gt = true;
             for (++i; i < argc; i++) {
                 arg = argv[i];
-                query_terms.push_back(arg);
+                if (arg == "-gt") query_terms.push_back(arg);
+                else if (arg == "-stem") use_stemming = true;
+                else for (const string& term : analyze_query(arg)) query_terms.push_back(term);
             }
         }
         else if (arg == "-phrase") is_phrase = true;
-        else query_terms.push_back(arg);
+        else if (arg == "-stem") use_stemming = true;
+        else for (const string& term : analyze_query(arg)) query_terms.push_back(term);
+    }
+    // The query terms are stemmed in one batch, leaving out the "-gt" separators
+    if (use_stemming) {
+        vector<string> terms;
+        for (const string& term : query_terms) if (term != "-gt") terms.push_back(term);
+        stem_strings(terms, stem_buffer);
+        size_t next = 0;
+        for (string& term : query_terms) if (term != "-gt") term = terms[next++];
     }
     if (is_gt && (ret_play || is_phrase)) {
         cout << "The '-gt' flag cannot be used in conjunction with other flags" << endl;
@@ -159,48 +194,54 @@ int main(int argc, char **argv) {
     }
 
 
-    // Read in file
-    std::ifstream json_file (filename);
+    // Read in file, inflating it on a background thread if it is gzip-compressed
+    GzipReader json_file (filename, true);
     if (!json_file.is_open()) {
         cout << "file could not be opened" << endl;
         exit(-1);
     }
+    GzipStreambuf json_buffer (json_file);
+    std::istream json_stream (&json_buffer);
 
     nlohmann::json j;
-    try { j = nlohmann::json::parse(json_file); }
+    try { j = nlohmann::json::parse(json_stream); }
     catch (nlohmann::json::parse_error &e) {
         cout << e.what() << endl;
         exit(-1);
     }
-
-    json_file.close();
+    if (json_file.failed()) {
+        cout << "compressed file could not be read completely" << endl;
+        exit(-1);
+    }
 
     // Create inverted list
+    vector<string> terms;
+    vector<int> positions;
     for (auto &play : j["corpus"]) {
         string playId = play["playId"];
         string sceneId = play["sceneId"];
         doc_info.emplace_back(sceneId, playId);
 
         int docId = play["sceneNum"];
-        string text = play["text"];
-
-        int pos = 0;
-        while (text.length() != 0) {
-            // Check if first char of string is ' '
-            if (text[0] == ' ') {
-                text = text.substr(1, string::npos);
-                continue;
-            }
-
-            int end_pos = (int) text.find(' ');
-            string term = text.substr(0, end_pos);
+        const string& text = play["text"].get_ref<const string&>();
+
+        // Analyze the text in place, terms are views into the analyzer's window and are copied out
+        // so the whole document can be stemmed at once
+        TermAnalyzer analyzer (text);
+        Token token;
+        terms.clear();
+        positions.clear();
+        while (analyzer.next(token)) {
+            terms.emplace_back(token.term);
+            positions.push_back((int) token.position);
+        }
+        if (use_stemming) stem_strings(terms, stem_buffer);
 
-            // Add term to inverted list
+        // Add terms to inverted list
+        for (size_t i = 0; i < terms.size(); i++) {
+            const string& term = terms[i];
             if (!inverted_list.count(term)) inverted_list.insert(std::make_pair(term, new Postings()));
-            inverted_list[term]->add_instance(docId, pos++);
-
-            if (end_pos == string::npos) break;
-            text = text.substr(end_pos + 1, string::npos);
+            inverted_list[term]->add_instance(docId, positions[i]);
         }
     }
 
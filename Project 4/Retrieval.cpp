@@ -1,4 +1,7 @@
-/* Citations:
+/*
+ * Build: g++ -std=c++17 -O2 -pthread Retrieval.cpp -o retrieval -lz
+ *
+ * Citations:
  * https://stackoverflow.com/questions/3450860/check-if-a-stdvector-contains-a-certain-object
  * https://www.geeksforgeeks.org/sorting-a-map-by-value-in-c-stl/
  * https://stackoverflow.com/questions/15056406/append-to-a-file-with-fstream-instead-of-overwriting
@@ -12,6 +15,9 @@
 #include <set>
 #include <cmath>
 #include "nlohmann/json.hpp"
+#include "../common/analyzer.hpp"
+#include "../common/gzip_reader.hpp"
+#include "../common/stemmer.hpp"
 
 
 // Avoiding use of `using namespace std;`
@@ -23,6 +29,10 @@ using std::pair;
 using std::cout;
 using std::endl;
 
+// Terms are whitespace- and punctuation-delimited, abbreviation-folded and lowercased, for the
+// collection and the queries alike. With -stem they are also stemmed, a document or query at a time.
+using TermAnalyzer = Analyzer<true, true, NoStopwords, NoStemming>;
+
 
 // Postings Class to store postings list
 class Postings {
@@ -51,6 +61,10 @@ class Postings {
 // Maps inverted_list[term] = Postings
 unordered_map<string, Postings*> inverted_list;
 
+// Set by -stem: terms are stemmed, through one reused batch
+bool use_stemming = false;
+StemBatch stem_buffer;
+
 // Vector with docId as indices => doc_info[docId] = pair<sceneId, playId>
 vector<pair<string, string>> doc_info;
 
@@ -139,51 +153,68 @@ string get_playId(int docId) { return doc_info[docId].second; }
 // Returns the sceneId given the docId
 string get_sceneId(int docId) { return doc_info[docId].first; }
 
+// Returns the terms of a query, normalized the same way as the collection
+vector<string> analyze_query(const string& query) {
+    vector<string> terms;
+    TermAnalyzer analyzer (query);
+    Token token;
+    while (analyzer.next(token)) terms.emplace_back(token.term);
+    return terms;
+}
+
 // Builds the index given the file
 void build_index(const char* filename) {
-    // Read in file
-    std::ifstream json_file (filename);
+    // Read in file, inflating it on a background thread if it is gzip-compressed
+    GzipReader json_file (filename, true);
     if (!json_file.is_open()) {
         cout << "File could not be opened" << endl;
         exit(-1);
     }
+    GzipStreambuf json_buffer (json_file);
+    std::istream json_stream (&json_buffer);
 
     nlohmann::json j;
-    try { j = nlohmann::json::parse(json_file); }
+    try { j = nlohmann::json::parse(json_stream); }
     catch (nlohmann::json::parse_error &e) {
         cout << e.what() << endl;
         exit(-1);
     }
-
-    json_file.close();
+    if (json_file.failed()) {
+        cout << "compressed file could not be read completely" << endl;
+        exit(-1);
+    }
 
     // Create inverted list
+    vector<string> terms;
+    vector<int> positions;
     for (auto &play : j["corpus"]) {
         string playId = play["playId"];
         string sceneId = play["sceneId"];
         doc_info.emplace_back(sceneId, playId);
 
         int docId = play["sceneNum"];
-        string text = play["text"];
-
-        int pos = 0;
-        while (text.length() != 0) {
-            // Check if first char of string is ' '
-            if (text[0] == ' ') {
-                text = text.substr(1, string::npos);
-                continue;
-            }
-
-            int end_pos = (int) text.find(' ');
-            string term = text.substr(0, end_pos);
+        const string& text = play["text"].get_ref<const string&>();
+
+        // Analyze the text in place, terms are views into the analyzer's window and are copied out
+        // so the whole document can be stemmed at once
+        TermAnalyzer analyzer (text);
+        Token token;
+        terms.clear();
+        positions.clear();
+        while (analyzer.next(token)) {
+            terms.emplace_back(token.term);
+            positions.push_back((int) token.position);
+        }
+        if (use_stemming) stem_strings(terms, stem_buffer);
 
-            // Add term to inverted list
+        // Add terms to inverted list
+        for (size_t i = 0; i < terms.size(); i++) {
+            const string& term = terms[i];
             if (!inverted_list.count(term)) { inverted_list.insert(std::make_pair(term, new Postings())); }
-            inverted_list[term]->add_instance(docId, pos++);
-
-            if (end_pos == string::npos) break;
-            text = text.substr(end_pos + 1, string::npos);
+            inverted_list[term]->add_instance(docId, positions[i]);
         }
+        // Scene length in terms
+        int pos = (int) analyzer.positions();
         scene_count[sceneId] = pos;
         if (!play_count.count(playId)) { play_count.insert(std::make_pair(playId, 0)); }
         play_count[playId] += pos;
@@ -352,25 +383,45 @@ void calculate_QL() {
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cout << "Usage: ./indexer <file.json> { -QL mu | -BM25 k1 k2 b }" << endl;
+        cout << "Usage: ./indexer <file.json[.gz]> { -QL mu | -BM25 k1 k2 b } [-stem]" << endl;
         exit(-1);
     }
 
-    build_index((const char*) argv[1]);
-
-    if ((string) argv[2] == "-QL") {
-        params.push_back(atof(argv[3]));
-        calculate_QL();
-    }
-    else if ((string) argv[2] == "-BM25") {
-        for (int i = 3; i < 6; i++) { params.push_back(atof(argv[i])); }
-        calculate_BM25();
+    // Parse command line arguments
+    string model;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-stem") use_stemming = true;
+        else if (arg == "-QL" && i + 1 < argc) {
+            model = arg;
+            params.assign(1, atof(argv[++i]));
+        }
+        else if (arg == "-BM25" && i + 3 < argc) {
+            model = arg;
+            params.clear();
+            for (int k = 0; k < 3; k++) { params.push_back(atof(argv[++i])); }
+        }
     }
-    else {
+    if (model.empty()) {
         cout << "Enter valid query processing model" << endl;
         exit(-1);
     }
 
+    build_index((const char*) argv[1]);
+
+    // Normalize the queries like the collection
+    for (vector<string> &query : Q) {
+        vector<string> terms;
+        for (const string &text : query) {
+            for (const string &term : analyze_query(text)) terms.push_back(term);
+        }
+        if (use_stemming) stem_strings(terms, stem_buffer);
+        query = terms;
+    }
+
+    if (model == "-QL") calculate_QL();
+    else calculate_BM25();
+
     return 0;
 }
 
@@ -0,0 +1,331 @@
+/*
+ * Text analysis shared by the tokenizer, the indexer and retrieval.
+ * TokenStream splits UTF-8 text into maximal runs of letters and digits, folding abbreviations ("U.S.A.")
+ * and lowercasing in the same pass, and yields string_views into its window without allocating. Analyzer
+ * runs the tokens through stopword removal and stemming and tags each with its position and the
+ * bytes or characters of the text it came from. Every stage is a template parameter, so a stage that is
+ * switched off costs nothing and indexing and querying normalize terms the same way by sharing one type.
+ */
+
+#ifndef ANALYZER_HPP
+#define ANALYZER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "char_classes.hpp"
+
+// Single-pass tokenizer over a block of UTF-8 text. Tokens are maximal runs of letter, mark and number
+// code points, everything else (including malformed bytes) is a delimiter. The text is classified a
+// window at a time by classify_block() into a lowercased copy plus bitmasks, and token boundaries are
+// found by scanning those masks. Only blocks holding non-ASCII bytes go through classify_utf8(). Tokens are
+// views into the window (or into the text when not lowercasing), except for words holding an
+// abbreviation, which are folded into a scratch buffer.
+template <bool FoldAbbreviations = true, bool Lowercase = true>
+class TokenStream {
+    std::string_view text;
+    size_t pos = 0;
+    bool use_simd;
+
+    // Lowercased copy of text[window_begin, window_end) and one bit per byte in 64-bit words
+    size_t window_size = 1 << 16;
+    size_t window_begin = 0;
+    size_t window_end = 0;
+    std::vector<char> lower;
+    std::vector<uint64_t> alnum_bits;
+    std::vector<uint64_t> abbrev_bits;
+    std::vector<uint64_t> dot_bits;
+    std::vector<uint64_t> space_bits;
+
+    // Tokens of the last folded word, viewing into scratch, and the classes of a non-ASCII word's bytes
+    std::string scratch;
+    std::string word_lower;
+    std::vector<uint64_t> word_alnum;
+    std::vector<std::string_view> pending;
+    size_t next_pending = 0;
+
+    // Bytes of text the last token came from, a whole word for folded tokens
+    size_t source_begin = 0;
+    size_t source_end = 0;
+
+    // Returns true if the '.' at i starts an abbreviation, i.e. the text reads ".x." inside one word
+    bool isAbbreviation(size_t i) const {
+        return i + 2 < text.size() && text[i] == '.' && text[i + 2] == '.' && !is_space_byte(text[i + 1]);
+    }
+
+    // Classifies the window of text starting at begin
+    void fillWindow(size_t begin) {
+        window_begin = begin;
+        window_end = std::min(text.size(), begin + window_size);
+        size_t length = window_end - window_begin;
+        size_t words = (length + 63) / 64;
+        lower.resize(words * 64);
+        alnum_bits.assign(words, 0);
+        abbrev_bits.assign(words, 0);
+        dot_bits.assign(words, 0);
+        space_bits.assign(words, 0);
+
+        const char* src = text.data() + window_begin;
+        char tail[CLASS_BLOCK];
+        for (size_t i = 0; i < length; i += CLASS_BLOCK) {
+            // Pad the last partial block with spaces, which belong to no class but whitespace
+            const char* block = src + i;
+            if (i + CLASS_BLOCK > length) {
+                std::fill(tail, tail + CLASS_BLOCK, ' ');
+                std::copy(src + i, src + length, tail);
+                block = tail;
+            }
+            BlockClasses classes = use_simd ? classify_block_simd(block, &lower[i]) : classify_block_scalar(block, &lower[i]);
+            size_t shift = i % 64;
+            alnum_bits[i / 64] |= (uint64_t) classes.alnum << shift;
+            dot_bits[i / 64] |= (uint64_t) classes.dot << shift;
+            space_bits[i / 64] |= (uint64_t) classes.space << shift;
+            if (classes.non_ascii) {
+                classify_utf8(text.data(), text.size(), window_begin + i, window_begin + std::min(length, i + CLASS_BLOCK),
+                              window_begin, alnum_bits.data(), lower.data());
+            }
+        }
+        if constexpr (!FoldAbbreviations) return;
+
+        // An abbreviation starts at a '.' with another '.' two bytes on and no whitespace between
+        for (size_t w = 0; w < words; w++) {
+            uint64_t next_dots = w + 1 < words ? dot_bits[w + 1] : 0;
+            uint64_t next_spaces = w + 1 < words ? space_bits[w + 1] : 0;
+            uint64_t dot_after_next = (dot_bits[w] >> 2) | (next_dots << 62);
+            uint64_t space_next = (space_bits[w] >> 1) | (next_spaces << 63);
+            abbrev_bits[w] = dot_bits[w] & dot_after_next & ~space_next;
+        }
+        // The last two bytes look past the window, check them against the text itself
+        for (size_t i = length < 2 ? 0 : length - 2; i < length; i++) {
+            if (isAbbreviation(window_begin + i)) abbrev_bits[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+    }
+
+    // Returns the first window offset at or after i whose bit is set in bits (or clear if invert)
+    size_t findBit(const std::vector<uint64_t>& bits, size_t i, bool invert) const {
+        size_t length = window_end - window_begin;
+        for (size_t w = i / 64; w < bits.size(); w++) {
+            uint64_t word = invert ? ~bits[w] : bits[w];
+            if (w == i / 64) word &= ~(uint64_t) 0 << (i % 64);
+            if (word) return std::min(length, w * 64 + __builtin_ctzll(word));
+        }
+        return length;
+    }
+
+    // Closes the token being folded into scratch at out, if it has any bytes
+    void endFoldedToken(size_t& token_start, size_t out) {
+        if (out > token_start) pending.emplace_back(scratch.data() + token_start, out - token_start);
+        token_start = out;
+    }
+
+    // Folds the rest of the current word, starting at start, and queues its tokens. Each byte is read
+    // once and copied to scratch at most once: a '.' with another '.' two bytes later starts an
+    // abbreviation and is dropped along with the '.' that ends it, and the byte after every dropped
+    // '.' is kept as is ("U.S.A." -> "USA").
+    void foldWord(size_t start) {
+        size_t end = start;
+        while (end < text.size() && !is_space_byte(text[end])) end++;
+        const char* w = text.data() + start;
+        size_t n = end - start;
+        scratch.resize(n);
+        pending.clear();
+        next_pending = 0;
+
+        // Multi-byte code points are classified up front, each of their bytes then kept or dropped alone
+        bool ascii = std::all_of(w, w + n, [](char c) { return (uint8_t) c < 0x80; });
+        if (!ascii) {
+            word_lower.resize(n);
+            word_alnum.assign((n + 63) / 64, 0);
+            for (size_t i = 0; i < n; i++) {
+                word_lower[i] = to_lower_byte(w[i]);
+                if (is_alnum_byte(w[i])) word_alnum[i / 64] |= (uint64_t) 1 << (i % 64);
+            }
+            classify_utf8(text.data(), text.size(), start, end, start, word_alnum.data(), &word_lower[0]);
+        }
+
+        size_t out = 0, token_start = 0;
+        bool in_abbreviation = false;
+        auto keep = [&](size_t i) {
+            bool alnum = ascii ? is_alnum_byte(w[i]) : (word_alnum[i / 64] >> (i % 64) & 1);
+            if (!alnum) endFoldedToken(token_start, out);
+            else if constexpr (Lowercase) scratch[out++] = ascii ? to_lower_byte(w[i]) : word_lower[i];
+            else scratch[out++] = w[i];
+        };
+        for (size_t i = 0; i < n;) {
+            if (w[i] == '.' && i + 2 < n && w[i + 2] == '.') in_abbreviation = true;
+            else if (in_abbreviation) in_abbreviation = false;
+            else {
+                keep(i++);
+                continue;
+            }
+            if (i + 1 < n) keep(i + 1);
+            i += 2;
+        }
+        endFoldedToken(token_start, out);
+
+        source_begin = start;
+        source_end = end;
+        pos = end;
+    }
+
+    public:
+        explicit TokenStream(std::string_view text, bool use_simd = true) : text(text), use_simd(use_simd) {}
+
+        // Stores the next token in token, returns false at the end of the text
+        bool next(std::string_view& token) {
+            while (true) {
+                if (next_pending < pending.size()) {
+                    token = pending[next_pending++];
+                    return true;
+                }
+                if (pos >= text.size()) return false;
+                if (pos >= window_end) fillWindow(pos);
+
+                // Skip delimiters up to the next token or abbreviation
+                size_t length = window_end - window_begin;
+                size_t from = pos - window_begin;
+                size_t start = length;
+                for (size_t w = from / 64; w < alnum_bits.size(); w++) {
+                    uint64_t word = alnum_bits[w] | abbrev_bits[w];
+                    if (w == from / 64) word &= ~(uint64_t) 0 << (from % 64);
+                    if (word) {
+                        start = std::min(length, w * 64 + __builtin_ctzll(word));
+                        break;
+                    }
+                }
+                if (start == length) {
+                    pos = window_end;
+                    continue;
+                }
+                if (!(alnum_bits[start / 64] >> (start % 64) & 1)) {
+                    foldWord(window_begin + start);
+                    continue;
+                }
+
+                // Scan the token
+                size_t end = findBit(alnum_bits, start, true);
+                if (end == length && window_end < text.size()) {
+                    // The token runs past the window, restart the window at the token (growing it if needed)
+                    if (start == 0) window_size *= 2;
+                    fillWindow(window_begin + start);
+                    pos = window_begin;
+                    continue;
+                }
+                if (end < length && (abbrev_bits[end / 64] >> (end % 64) & 1)) {
+                    foldWord(window_begin + start);
+                    continue;
+                }
+                pos = window_begin + end;
+                source_begin = window_begin + start;
+                source_end = pos;
+                if constexpr (Lowercase) token = std::string_view(&lower[start], end - start);
+                else token = text.substr(source_begin, end - start);
+                return true;
+            }
+        }
+
+        // Returns the number of bytes consumed so far
+        size_t offset() const { return pos; }
+
+        // Returns the bytes of text the last token came from
+        size_t token_begin() const { return source_begin; }
+        size_t token_end() const { return source_end; }
+};
+
+// One analyzed term. position counts every token of the text, removed stopwords included, so
+// phrases do not match across a removed word. [begin, end) is where in the text it came from, the
+// whole word for tokens of a folded abbreviation: bytes, or characters (code points) when the
+// analyzer counts them. A malformed byte counts as one character, as it does when the text is
+// classified.
+struct Token {
+    std::string_view term;
+    uint32_t position;
+    size_t begin;
+    size_t end;
+};
+
+// Stage policies that switch stopword removal or stemming off
+struct NoStopwords {
+    bool contains(std::string_view) const { return false; }
+};
+
+struct NoStemming {
+    std::string_view stem(std::string_view word) const { return word; }
+};
+
+// Tokenize, fold abbreviations, lowercase, remove stopwords and stem. Stopwords is any type with
+// contains(string_view) (e.g. PerfectHashView), Stemmer any type with stem(string_view) returning a
+// view that stays valid until the next call (e.g. PorterStemmer). With CharOffsets, token ranges are
+// counted in characters, which decodes the text up to every token; callers that never read the
+// ranges leave it off and get byte offsets for free.
+template <bool FoldAbbreviations = true, bool Lowercase = true, class Stopwords = NoStopwords, class Stemmer = NoStemming,
+          bool CharOffsets = false>
+class Analyzer {
+    TokenStream<FoldAbbreviations, Lowercase> tokens;
+    Stopwords stopwords;
+    Stemmer stemmer;
+    uint32_t next_position = 0;
+
+    // Code points of text[0, counted_bytes), and the character range of the last token (CharOffsets)
+    std::string_view text;
+    size_t counted_bytes = 0;
+    size_t counted_chars = 0;
+    size_t char_begin = 0;
+    size_t char_end = 0;
+
+    // Returns the number of code points before byte offset at, which must not lie before the last one.
+    // Tokens come in text order, so the whole text is decoded once.
+    size_t charOffset(size_t at) {
+        while (counted_bytes < at) {
+            if ((uint8_t) text[counted_bytes] < 0x80) counted_bytes++;
+            else {
+                uint32_t cp;
+                counted_bytes += utf8_decode(text.data() + counted_bytes, text.size() - counted_bytes, cp);
+            }
+            counted_chars++;
+        }
+        return counted_chars;
+    }
+
+    public:
+        explicit Analyzer(std::string_view text, Stopwords stopwords = Stopwords(), Stemmer stemmer = Stemmer(), bool use_simd = true)
+            : tokens(text, use_simd), stopwords(stopwords), stemmer(std::move(stemmer)), text(text) {}
+
+        // Stores the next term in token, returns false at the end of the text. The term is valid
+        // until the next call.
+        bool next(Token& token) {
+            std::string_view word;
+            while (tokens.next(word)) {
+                uint32_t position = next_position++;
+                if (stopwords.contains(word)) continue;
+                token.term = stemmer.stem(word);
+                token.position = position;
+                if constexpr (CharOffsets) {
+                    // Tokens of one folded word share its range, only the first one moves the count on
+                    if (tokens.token_begin() >= counted_bytes) {
+                        char_begin = charOffset(tokens.token_begin());
+                        char_end = charOffset(tokens.token_end());
+                    }
+                    token.begin = char_begin;
+                    token.end = char_end;
+                }
+                else {
+                    token.begin = tokens.token_begin();
+                    token.end = tokens.token_end();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        // Returns the number of tokens seen so far, removed stopwords included
+        uint32_t positions() const { return next_position; }
+
+        // Returns the stemmer, e.g. to read cache statistics
+        const Stemmer& stemming() const { return stemmer; }
+};
+
+#endif
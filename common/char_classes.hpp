@@ -0,0 +1,257 @@
+/*
+ * Block character classification for the tokenizer.
+ * Each call looks at 32 bytes, writes them lowercased (ASCII only) and returns one bit per byte
+ * for alphanumerics, '.', whitespace and non-ASCII bytes. Uses AVX2 or SSE4.2 when the compiler
+ * targets them (e.g. -march=native), otherwise a portable scalar loop with identical results.
+ * Blocks holding non-ASCII bytes are finished by classify_utf8(), which decodes UTF-8 and looks
+ * code points up in the Unicode tables, so pure ASCII text never leaves the vector path.
+ */
+
+#ifndef CHAR_CLASSES_HPP
+#define CHAR_CLASSES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include "unicode_tables.hpp"
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+// ASCII-only character classes, independent of the current locale
+inline bool is_alnum_byte(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+inline bool is_space_byte(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+inline char to_lower_byte(char c) { return (c >= 'A' && c <= 'Z') ? (char) (c + ('a' - 'A')) : c; }
+
+// Number of bytes classified per call
+const size_t CLASS_BLOCK = 32;
+
+// Bit i of each mask describes byte i of the block
+struct BlockClasses {
+    uint32_t alnum;
+    uint32_t dot;
+    uint32_t space;
+    uint32_t non_ascii;
+};
+
+// Portable version, one byte at a time
+inline BlockClasses classify_block_scalar(const char* src, char* lower) {
+    BlockClasses classes = {0, 0, 0, 0};
+    for (size_t i = 0; i < CLASS_BLOCK; i++) {
+        char c = src[i];
+        bool upper = c >= 'A' && c <= 'Z';
+        bool alnum = upper || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+        lower[i] = upper ? (char) (c + ('a' - 'A')) : c;
+        classes.alnum |= (uint32_t) alnum << i;
+        classes.dot |= (uint32_t) (c == '.') << i;
+        classes.space |= (uint32_t) (c == ' ' || (c >= '\t' && c <= '\r')) << i;
+        classes.non_ascii |= (uint32_t) ((uint8_t) c >= 0x80) << i;
+    }
+    return classes;
+}
+
+#if defined(__AVX2__)
+// Returns 0xFF in every lane of v that lies within [lo, hi]. Bytes >= 0x80 compare as negative and
+// therefore never match an ASCII range.
+inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((char) (lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (hi + 1)), v));
+}
+
+inline BlockClasses classify_block_simd(const char* src, char* lower) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) src);
+    __m256i upper = in_range_avx2(v, 'A', 'Z');
+    __m256i letter = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = in_range_avx2(v, '0', '9');
+    __m256i dot = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range_avx2(v, '\t', '\r'));
+
+    _mm256_storeu_si256((__m256i*) lower, _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))));
+
+    BlockClasses classes;
+    classes.alnum = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(letter, digit));
+    classes.dot = (uint32_t) _mm256_movemask_epi8(dot);
+    classes.space = (uint32_t) _mm256_movemask_epi8(space);
+    classes.non_ascii = (uint32_t) _mm256_movemask_epi8(v);
+    return classes;
+}
+#elif defined(__SSE4_2__)
+// Classifies 16 bytes with explicit-length range compares, so NUL bytes do not end the string
+inline void classify_half_sse42(const char* src, char* lower, uint32_t& alnum, uint32_t& dot, uint32_t& space, uint32_t& non_ascii) {
+    const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK;
+    __m128i v = _mm_loadu_si128((const __m128i*) src);
+    __m128i alnum_ranges = _mm_setr_epi8('0', '9', 'A', 'Z', 'a', 'z', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i upper_range = _mm_setr_epi8('A', 'Z', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i space_ranges = _mm_setr_epi8(' ', ' ', '\t', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    alnum = (uint32_t) _mm_cvtsi128_si32(_mm_cmpestrm(alnum_ranges, 6, v, 16, mode));
+    space = (uint32_t) _mm_cvtsi128_si32(_mm_cmpestrm(space_ranges, 4, v, 16, mode));
+    dot = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+    non_ascii = (uint32_t) _mm_movemask_epi8(v);
+
+    __m128i upper = _mm_cmpestrm(upper_range, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_UNIT_MASK);
+    _mm_storeu_si128((__m128i*) lower, _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+}
+
+inline BlockClasses classify_block_simd(const char* src, char* lower) {
+    uint32_t alnum_lo, dot_lo, space_lo, non_ascii_lo, alnum_hi, dot_hi, space_hi, non_ascii_hi;
+    classify_half_sse42(src, lower, alnum_lo, dot_lo, space_lo, non_ascii_lo);
+    classify_half_sse42(src + 16, lower + 16, alnum_hi, dot_hi, space_hi, non_ascii_hi);
+
+    BlockClasses classes;
+    classes.alnum = alnum_lo | (alnum_hi << 16);
+    classes.dot = dot_lo | (dot_hi << 16);
+    classes.space = space_lo | (space_hi << 16);
+    classes.non_ascii = non_ascii_lo | (non_ascii_hi << 16);
+    return classes;
+}
+#else
+inline BlockClasses classify_block_simd(const char* src, char* lower) { return classify_block_scalar(src, lower); }
+#endif
+
+// Code point returned for bytes that do not start a well-formed UTF-8 sequence
+const uint32_t UTF8_INVALID = 0xffffffff;
+
+inline bool is_utf8_continuation(char c) { return ((uint8_t) c & 0xc0) == 0x80; }
+
+// Decodes the code point starting at s, of which avail bytes are readable, and returns its length.
+// Overlong, surrogate, out-of-range and truncated sequences and stray continuation bytes decode as
+// a single byte of UTF8_INVALID.
+inline size_t utf8_decode(const char* s, size_t avail, uint32_t& cp) {
+    uint8_t b0 = (uint8_t) s[0];
+    cp = UTF8_INVALID;
+    if (b0 < 0x80) {
+        cp = b0;
+        return 1;
+    }
+    size_t length = b0 >= 0xc2 && b0 <= 0xdf ? 2 : b0 >= 0xe0 && b0 <= 0xef ? 3 : b0 >= 0xf0 && b0 <= 0xf4 ? 4 : 0;
+    if (length == 0 || avail < length) return 1;
+    for (size_t i = 1; i < length; i++) if (!is_utf8_continuation(s[i])) return 1;
+    uint8_t b1 = (uint8_t) s[1];
+    if ((b0 == 0xe0 && b1 < 0xa0) || (b0 == 0xed && b1 > 0x9f) || (b0 == 0xf0 && b1 < 0x90) || (b0 == 0xf4 && b1 > 0x8f)) return 1;
+    uint32_t value = b0 & (0x7f >> length);
+    for (size_t i = 1; i < length; i++) value = value << 6 | ((uint8_t) s[i] & 0x3f);
+    cp = value;
+    return length;
+}
+
+// Writes the UTF-8 form of a valid code point to out and returns its length
+inline size_t utf8_encode(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char) (0xc0 | cp >> 6);
+        out[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char) (0xe0 | cp >> 12);
+        out[1] = (char) (0x80 | (cp >> 6 & 0x3f));
+        out[2] = (char) (0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char) (0xf0 | cp >> 18);
+    out[1] = (char) (0x80 | (cp >> 12 & 0x3f));
+    out[2] = (char) (0x80 | (cp >> 6 & 0x3f));
+    out[3] = (char) (0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Unicode classes of code points. The two-byte range U+0080-U+07FF, which covers the Latin, Greek,
+// Cyrillic, Hebrew and Arabic alphabets, is expanded into flat tables (a bitmap and lowercase
+// deltas, under 4 KB); longer code points binary-search the ranges.
+class UnicodeClasses {
+    static constexpr uint32_t FLAT_END = 0x800;
+    uint64_t word_bits[FLAT_END / 64] = {};
+    int16_t lower_delta[FLAT_END] = {};
+
+    static bool searchWord(uint32_t cp) {
+        auto it = std::upper_bound(std::begin(UNICODE_WORD_RANGES), std::end(UNICODE_WORD_RANGES), cp,
+                                   [](uint32_t c, const UnicodeRange& r) { return c < r.first; });
+        return it != std::begin(UNICODE_WORD_RANGES) && cp <= (it - 1)->last;
+    }
+
+    static uint32_t searchLower(uint32_t cp) {
+        auto it = std::upper_bound(std::begin(UNICODE_LOWER_RANGES), std::end(UNICODE_LOWER_RANGES), cp,
+                                   [](uint32_t c, const UnicodeCaseRange& r) { return c < r.first; });
+        if (it == std::begin(UNICODE_LOWER_RANGES)) return cp;
+        const UnicodeCaseRange& r = *(it - 1);
+        return cp <= r.last && (cp - r.first) % r.stride == 0 ? (uint32_t) ((int32_t) cp + r.delta) : cp;
+    }
+
+    public:
+        UnicodeClasses() {
+            for (uint32_t cp = 0x80; cp < FLAT_END; cp++) {
+                if (searchWord(cp)) word_bits[cp / 64] |= (uint64_t) 1 << (cp % 64);
+                lower_delta[cp] = (int16_t) ((int32_t) searchLower(cp) - (int32_t) cp);
+            }
+        }
+
+        // Returns true if the code point is a letter, mark or number
+        bool is_word(uint32_t cp) const {
+            if (cp < 0x80) return is_alnum_byte((char) cp);
+            if (cp < FLAT_END) return word_bits[cp / 64] >> (cp % 64) & 1;
+            return cp != UTF8_INVALID && searchWord(cp);
+        }
+
+        // Returns the lowercase code point, of the same UTF-8 length
+        uint32_t to_lower(uint32_t cp) const {
+            if (cp < 0x80) return (uint32_t) (uint8_t) to_lower_byte((char) cp);
+            if (cp < FLAT_END) return (uint32_t) ((int32_t) cp + lower_delta[cp]);
+            return cp == UTF8_INVALID ? cp : searchLower(cp);
+        }
+};
+
+inline const UnicodeClasses& unicode_classes() {
+    static const UnicodeClasses classes;
+    return classes;
+}
+
+// Classifies the non-ASCII bytes of text[begin, end) (text holds size bytes). Every byte of a word
+// code point gets bit (i - base) set in alnum, and lower[i - base] is set to the byte of its
+// lowercase form. A code point may start before begin or end after end: it is decoded from text
+// as a whole, so a byte is classified the same way whatever range it is seen in.
+inline void classify_utf8(const char* text, size_t size, size_t begin, size_t end, size_t base, uint64_t* alnum, char* lower) {
+    const UnicodeClasses& classes = unicode_classes();
+    for (size_t i = begin; i < end;) {
+        if ((uint8_t) text[i] < 0x80) {
+            i++;
+            continue;
+        }
+        // Find the start of the sequence holding byte i
+        size_t start = i;
+        while (start > 0 && i - start < 3 && is_utf8_continuation(text[start])) start--;
+        uint32_t cp;
+        size_t length = utf8_decode(text + start, size - start, cp);
+        if (start + length <= i) {
+            // A stray continuation byte, not part of any word
+            i++;
+            continue;
+        }
+        char lowered[4];
+        utf8_encode(cp == UTF8_INVALID ? 0 : classes.to_lower(cp), lowered);
+        bool word = classes.is_word(cp);
+        for (size_t j = std::max(start, begin); j < std::min(start + length, end); j++) {
+            if (word) alnum[(j - base) / 64] |= (uint64_t) 1 << ((j - base) % 64);
+            if (cp != UTF8_INVALID) lower[j - base] = lowered[j - start];
+        }
+        i = start + length;
+    }
+}
+
+// Returns true if classify_block_simd uses vector instructions in this build
+inline bool has_simd_classes() {
+#if defined(__AVX2__) || defined(__SSE4_2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,87 @@
+# Writes unicode_tables.hpp from the Unicode data of the running Python, run in common/ as
+#   python3 gen_unicode_tables.py > unicode_tables.hpp
+# The committed tables were generated with Python 3.11.7, whose unicodedata holds Unicode 14.0.0.
+
+import platform
+import sys
+import unicodedata
+
+WORD_CATEGORIES = ('L', 'M', 'N')
+
+
+def word_ranges():
+    ranges = []
+    for cp in range(0x80, sys.maxunicode + 1):
+        if not unicodedata.category(chr(cp)).startswith(WORD_CATEGORIES):
+            continue
+        if ranges and ranges[-1][1] == cp - 1:
+            ranges[-1][1] = cp
+        else:
+            ranges.append([cp, cp])
+    return ranges
+
+
+# Simple lowercase mappings that keep the UTF-8 length, grouped into runs of equal delta and stride
+def lower_ranges():
+    mapped = []
+    for cp in range(0x80, sys.maxunicode + 1):
+        lower = chr(cp).lower()
+        if len(lower) != 1 or ord(lower) == cp:
+            continue
+        if len(lower.encode('utf-8')) != len(chr(cp).encode('utf-8')):
+            continue
+        mapped.append((cp, ord(lower) - cp))
+    ranges = []
+    for cp, delta in mapped:
+        if ranges:
+            first, last, run_delta, stride = ranges[-1]
+            if run_delta == delta and first == last and cp - last in (1, 2):
+                ranges[-1] = [first, cp, delta, cp - last]
+                continue
+            if run_delta == delta and cp - last == stride:
+                ranges[-1][1] = cp
+                continue
+        ranges.append([cp, cp, delta, 1])
+    return ranges
+
+
+def rows(entries, per_row):
+    for i in range(0, len(entries), per_row):
+        print('    ' + ' '.join(entries[i:i + per_row]))
+
+
+print('''/*
+ * Unicode %s character data for UTF-8 tokenizing, generated from Python %s's unicodedata module by
+ * running in common/ python3 gen_unicode_tables.py > unicode_tables.hpp
+ * UNICODE_WORD_RANGES lists the code points from U+0080 up that belong to words: letters, marks
+ * and numbers (general categories L*, M* and N*). UNICODE_LOWER_RANGES holds the simple lowercase
+ * mappings that keep the UTF-8 length of the code point, so text can be lowercased in place: every
+ * stride-th code point from first to last maps to itself + delta.
+ */
+
+#ifndef UNICODE_TABLES_HPP
+#define UNICODE_TABLES_HPP
+
+#include <cstdint>
+
+struct UnicodeRange {
+    uint32_t first;
+    uint32_t last;
+};
+
+struct UnicodeCaseRange {
+    uint32_t first;
+    uint32_t last;
+    int32_t delta;
+    uint32_t stride;
+};
+
+inline constexpr UnicodeRange UNICODE_WORD_RANGES[] = {''' % (unicodedata.unidata_version.rsplit('.', 1)[0], platform.python_version()))
+rows(['{0x%04X, 0x%04X},' % (first, last) for first, last in word_ranges()], 6)
+print('};')
+print()
+print('inline constexpr UnicodeCaseRange UNICODE_LOWER_RANGES[] = {')
+rows(['{0x%04X, 0x%04X, %d, %d},' % tuple(r) for r in lower_ranges()], 4)
+print('};')
+print()
+print('#endif')
@@ -0,0 +1,259 @@
+/*
+ * Streaming reader for gzip-compressed (or plain) files.
+ * Compressed input is read in large blocks and inflated with zlib, including files made of several
+ * concatenated gzip members. Files without the gzip magic are passed through unchanged, so every
+ * corpus reader can open either kind. With a background thread, inflate runs up to a bounded number
+ * of blocks ahead of the consumer, overlapping decompression with tokenizing or parsing.
+ * Link with -lz (and -pthread).
+ */
+
+#ifndef GZIP_READER_HPP
+#define GZIP_READER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Returns true if the file starts with the gzip magic bytes
+inline bool is_gzip_file(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    unsigned char magic[2] = {0, 0};
+    bool gzip = read(fd, magic, 2) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    close(fd);
+    return gzip;
+}
+
+class GzipReader {
+    int fd = -1;
+    bool compressed = false;
+    bool stream_open = false;
+    bool end_of_input = false;
+    bool end_of_output = false;
+    bool error = false;
+    z_stream stream;
+    std::vector<unsigned char> input;
+    size_t input_begin = 0;     // Unconsumed input of a plain file is input[input_begin, input_end)
+    size_t input_end = 0;
+
+    // Inflated blocks handed from the background thread to read()
+    bool background = false;
+    size_t block_bytes;
+    size_t max_blocks;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> filled;
+    std::vector<std::vector<char>> spare;
+    std::vector<char> current;
+    size_t current_pos = 0;
+    bool worker_done = false;
+    bool stopping = false;
+
+    // Reads the next block of the file, returns false at its end
+    bool fillInput() {
+        if (end_of_input) return false;
+        ssize_t n;
+        do n = ::read(fd, input.data(), input.size());
+        while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            if (n < 0) error = true;
+            end_of_input = true;
+            return false;
+        }
+        input_begin = 0;
+        input_end = (size_t) n;
+        stream.next_in = input.data();
+        stream.avail_in = (uInt) n;
+        return true;
+    }
+
+    // Produces up to n bytes in out on the calling thread, fewer only at the end of the data
+    size_t produce(char* out, size_t n) {
+        if (end_of_output || n == 0) return 0;
+        if (!compressed) {
+            size_t done = 0;
+            while (done < n) {
+                if (input_begin == input_end && !fillInput()) break;
+                size_t take = std::min(n - done, input_end - input_begin);
+                memcpy(out + done, &input[input_begin], take);
+                input_begin += take;
+                done += take;
+            }
+            if (done < n) end_of_output = true;
+            return done;
+        }
+
+        stream.next_out = (Bytef*) out;
+        stream.avail_out = (uInt) n;
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0 && !fillInput()) {
+                // The file ended inside a member
+                error = true;
+                break;
+            }
+            int status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_STREAM_END) {
+                // Another member may follow
+                if (stream.avail_in == 0 && !fillInput()) {
+                    end_of_output = true;
+                    break;
+                }
+                inflateReset(&stream);
+            }
+            else if (status != Z_OK && status != Z_BUF_ERROR) {
+                error = true;
+                break;
+            }
+        }
+        if (error) end_of_output = true;
+        return n - stream.avail_out;
+    }
+
+    // Background thread: inflates blocks until the data ends or the reader is destroyed
+    void run() {
+        while (true) {
+            std::vector<char> block;
+            {
+                std::unique_lock<std::mutex> guard (lock);
+                changed.wait(guard, [this] { return stopping || filled.size() < max_blocks; });
+                if (stopping) break;
+                if (!spare.empty()) {
+                    block.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+            block.resize(block_bytes);
+            block.resize(produce(block.data(), block.size()));
+            bool last = block.size() < block_bytes;
+
+            std::lock_guard<std::mutex> guard (lock);
+            if (!block.empty()) filled.push_back(std::move(block));
+            if (last) worker_done = true;
+            changed.notify_all();
+            if (last) break;
+        }
+    }
+
+    public:
+        // Opens filename, inflating it if it is gzip-compressed. block_bytes is the size of each read
+        // from disk and of each inflated block; with background set, up to max_blocks inflated blocks
+        // are prepared ahead of read().
+        explicit GzipReader(const char* filename, bool background = false, size_t block_bytes = 1 << 20, size_t max_blocks = 4)
+            : input(std::max<size_t>(block_bytes, 4096)), block_bytes(std::max<size_t>(block_bytes, 4096)),
+              max_blocks(std::max<size_t>(max_blocks, 1)) {
+            fd = open(filename, O_RDONLY);
+            if (fd < 0) return;
+            memset(&stream, 0, sizeof(stream));
+            if (fillInput()) compressed = input_end >= 2 && input[0] == 0x1f && input[1] == 0x8b;
+            if (compressed) {
+                // 15 window bits + 16 selects the gzip wrapper
+                if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+                    error = true;
+                    end_of_output = true;
+                }
+                else stream_open = true;
+            }
+            this->background = background;
+            if (background) worker = std::thread(&GzipReader::run, this);
+        }
+
+        ~GzipReader() {
+            if (worker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> guard (lock);
+                    stopping = true;
+                }
+                changed.notify_all();
+                worker.join();
+            }
+            if (stream_open) inflateEnd(&stream);
+            if (fd >= 0) close(fd);
+        }
+
+        GzipReader(const GzipReader&) = delete;
+        GzipReader& operator=(const GzipReader&) = delete;
+
+        // Returns true if the file could be opened
+        bool is_open() const { return fd >= 0; }
+
+        // Returns true if the file is being inflated
+        bool is_compressed() const { return compressed; }
+
+        // Returns true if reading failed or the compressed data was corrupt or truncated. Only
+        // meaningful once read() has returned less than was asked for.
+        bool failed() {
+            if (!background) return error;
+            std::lock_guard<std::mutex> guard (lock);
+            return worker_done && error;
+        }
+
+        // Reads up to n bytes into out, fewer only at the end of the data
+        size_t read(char* out, size_t n) {
+            if (fd < 0) return 0;
+            if (!background) return produce(out, n);
+
+            size_t done = 0;
+            while (done < n) {
+                if (current_pos == current.size()) {
+                    std::unique_lock<std::mutex> guard (lock);
+                    if (!current.empty()) spare.push_back(std::move(current));
+                    current.clear();
+                    current_pos = 0;
+                    changed.wait(guard, [this] { return !filled.empty() || worker_done; });
+                    if (filled.empty()) break;
+                    current.swap(filled.front());
+                    filled.pop_front();
+                    changed.notify_all();
+                }
+                size_t take = std::min(n - done, current.size() - current_pos);
+                memcpy(out + done, &current[current_pos], take);
+                current_pos += take;
+                done += take;
+            }
+            return done;
+        }
+
+        // Appends the rest of the data to text, returns false if it could not be read completely
+        bool read_all(std::string& text) {
+            size_t old_size = text.size();
+            while (true) {
+                text.resize(old_size + block_bytes);
+                size_t n = read(&text[old_size], block_bytes);
+                old_size += n;
+                if (n < block_bytes) break;
+            }
+            text.resize(old_size);
+            return !failed();
+        }
+};
+
+// Adapts a GzipReader to std::istream, e.g. for nlohmann::json::parse
+class GzipStreambuf : public std::streambuf {
+    GzipReader& reader;
+    std::vector<char> buffer;
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            size_t n = reader.read(buffer.data(), buffer.size());
+            if (n == 0) return traits_type::eof();
+            setg(buffer.data(), buffer.data(), buffer.data() + n);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    public:
+        explicit GzipStreambuf(GzipReader& reader, size_t buffer_bytes = 1 << 16) : reader(reader), buffer(buffer_bytes) {}
+};
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Fast 64-bit hashing of short byte strings (tokens and stems), 8 bytes per step.
+ */
+
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+
+// Finalizer from MurmurHash3, spreads every input bit over the whole word
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Reads 1 to 7 bytes without a variable-length copy; the result is unique for a given length
+inline uint64_t load_tail(const char* data, size_t length) {
+    if (length >= 4) {
+        uint32_t first, last;
+        memcpy(&first, data, 4);
+        memcpy(&last, data + length - 4, 4);
+        return ((uint64_t) first << 32) | last;
+    }
+    return ((uint64_t) (uint8_t) data[0] << 16) | ((uint64_t) (uint8_t) data[length >> 1] << 8) | (uint8_t) data[length - 1];
+}
+
+inline uint64_t hash_bytes(const char* data, size_t length, uint64_t seed = 0) {
+    uint64_t h = seed ^ 0x9e3779b97f4a7c15ULL ^ (length * 0xff51afd7ed558ccdULL);
+    while (length >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data, 8);
+        h = (h ^ chunk) * 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 29;
+        data += 8;
+        length -= 8;
+    }
+    if (length > 0) h = (h ^ load_tail(data, length)) * 0xc4ceb9fe1a85ec53ULL;
+    return mix64(h);
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Fixed-size term value for the counting path.
+ * A term of up to INLINE_TERM_CAPACITY bytes is copied into the object itself, next to its length
+ * and its hash_bytes() hash, so a term is 32 bytes that can be passed by value and stored without
+ * touching the heap. The hash is computed once and reused by every table the term goes into.
+ * Longer terms fall back to a view of the caller's bytes, which must outlive the object.
+ */
+
+#ifndef INLINE_TERM_HPP
+#define INLINE_TERM_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "hash.hpp"
+
+const size_t INLINE_TERM_CAPACITY = 23;
+
+class InlineTerm {
+    // Inline bytes, or the address and length of an outside term when length is OUTSIDE
+    char bytes[INLINE_TERM_CAPACITY];
+    uint8_t length = 0;
+    uint64_t term_hash = 0;
+
+    static constexpr uint8_t OUTSIDE = 0xff;
+
+    public:
+        InlineTerm() = default;
+
+        explicit InlineTerm(std::string_view term) : InlineTerm(term, hash_bytes(term.data(), term.size())) {}
+
+        // Takes the term's hash_bytes() hash from the caller
+        InlineTerm(std::string_view term, uint64_t h) : term_hash(h) {
+            if (term.size() <= INLINE_TERM_CAPACITY) {
+                memcpy(bytes, term.data(), term.size());
+                length = (uint8_t) term.size();
+                return;
+            }
+            const char* data = term.data();
+            size_t size = term.size();
+            memcpy(bytes, &data, sizeof(data));
+            memcpy(bytes + sizeof(data), &size, sizeof(size));
+            length = OUTSIDE;
+        }
+
+        // Returns the term's bytes, valid as long as the object (or, for a long term, the original bytes)
+        std::string_view view() const {
+            if (length != OUTSIDE) return std::string_view(bytes, length);
+            const char* data;
+            size_t size;
+            memcpy(&data, bytes, sizeof(data));
+            memcpy(&size, bytes + sizeof(data), sizeof(size));
+            return std::string_view(data, size);
+        }
+
+        // Returns hash_bytes() of the term
+        uint64_t hash() const { return term_hash; }
+
+        // Returns true if the bytes are held by the object
+        bool is_inline() const { return length != OUTSIDE; }
+
+        bool operator==(const InlineTerm& other) const { return term_hash == other.term_hash && view() == other.view(); }
+};
+
+static_assert(sizeof(InlineTerm) == 32, "InlineTerm should fill half a cache line");
+
+#endif
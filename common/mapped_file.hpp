@@ -0,0 +1,55 @@
+/*
+ * Read-only memory mapping of a whole file.
+ * The file is mapped privately and marked for sequential access, so the kernel reads ahead of the
+ * scan. An empty file opens as an empty view, since mmap rejects zero-length mappings. The mapping
+ * lasts as long as the object.
+ */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile {
+    const char* data = nullptr;
+    size_t length = 0;
+    bool opened = false;
+
+    public:
+        explicit MappedFile(const char* filename) {
+            int fd = open(filename, O_RDONLY);
+            if (fd < 0) return;
+            struct stat info;
+            if (fstat(fd, &info) == 0) {
+                length = (size_t) info.st_size;
+                // mmap rejects zero-length mappings, an empty file is just an empty view
+                if (length == 0) opened = true;
+                else {
+                    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr != MAP_FAILED) {
+                        data = (const char*) addr;
+                        opened = true;
+                        madvise(addr, length, MADV_SEQUENTIAL);
+                    }
+                }
+            }
+            close(fd);
+        }
+
+        ~MappedFile() { if (data) munmap((void*) data, length); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Returns true if the file could be opened and mapped
+        bool is_open() const { return opened; }
+
+        // Returns the mapped bytes
+        std::string_view view() const { return std::string_view(data, data ? length : 0); }
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Allocation-free version of porterStem() (steps 1a and 1b).
+ * The word is edited in place in a fixed buffer, and each step switches on the last character so
+ * only the suffixes that can match are compared. Results are identical to porterStem().
+ * StemBatch stems many words in one call: words whose last character no rule can match are
+ * picked out 32 at a time with SIMD compares and returned as they are, without being copied.
+ */
+
+#ifndef STEMMER_HPP
+#define STEMMER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+inline bool is_vowel(char c) { return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u'; }
+
+// Returns true if w[0, end) holds a vowel
+inline bool has_vowel(const char* w, size_t end) {
+    for (size_t i = 0; i < end; i++) if (is_vowel(w[i])) return true;
+    return false;
+}
+
+// Compares the end of w[0, l) against a string literal, the length is known at compile time
+template <size_t N>
+inline bool ends_with(const char* w, size_t l, const char (&suffix)[N]) {
+    return l >= N - 1 && memcmp(w + l - (N - 1), suffix, N - 1) == 0;
+}
+
+// adjustWord() on the stem w[0, l), returns the new length. May write w[l].
+inline size_t adjust_stem(char* w, size_t l) {
+    if (l < 2 || !has_vowel(w, l)) return l;
+    char a = w[l - 2], b = w[l - 1];
+    if ((a == 'a' && b == 't') || (a == 'b' && b == 'l') || (a == 'i' && b == 'z')) {
+        w[l] = 'e';
+        return l + 1;
+    }
+    if (a == b && a != 'l' && a != 's' && a != 'z') return l - 1;
+    if (l < 4) {
+        w[l] = 'e';
+        return l + 1;
+    }
+    return l;
+}
+
+// Step 1a: plurals and "-ied"
+inline size_t stem_step_1a(const char* w, size_t l) {
+    switch (w[l - 1]) {
+        case 's':
+            if (l > 4 && ends_with(w, l, "sses")) return l - 2;
+            if (l > 3) {
+                if (ends_with(w, l, "ies")) return l > 4 ? l - 2 : l - 1;
+                return has_vowel(w, l - 2) ? l - 1 : l;
+            }
+            if (l < 2 || w[l - 2] == 'u' || w[l - 2] == 's') return l;
+            return l > 2 && has_vowel(w, l - 2) ? l - 1 : l;
+        case 'd':
+            if (l > 3 && ends_with(w, l, "ied")) return l > 4 ? l - 2 : l - 1;
+            return l;
+        default:
+            return l;
+    }
+}
+
+// Step 1b: "-eed", "-ed", "-ing" and their "-ly" forms
+inline size_t stem_step_1b(char* w, size_t l) {
+    switch (w[l - 1]) {
+        case 'y':
+            if (l > 7 && ends_with(w, l, "eedly") && is_vowel(w[l - 7]) && !is_vowel(w[l - 6])) return l - 3;
+            if (l > 5 && ends_with(w, l, "ingly")) return adjust_stem(w, l - 5);
+            if (l > 4 && ends_with(w, l, "edly")) return adjust_stem(w, l - 4);
+            return l;
+        case 'd':
+            if (l > 5 && ends_with(w, l, "eed") && is_vowel(w[l - 5]) && !is_vowel(w[l - 4])) return l - 1;
+            if (l > 2 && ends_with(w, l, "ed")) return adjust_stem(w, l - 2);
+            return l;
+        case 'g':
+            if (l > 3 && ends_with(w, l, "ing")) return adjust_stem(w, l - 3);
+            return l;
+        default:
+            return l;
+    }
+}
+
+// Stems w[0, l) in place and returns the new length. The stem is never longer than the word.
+inline size_t stem_in_place(char* w, size_t l) {
+    if (l == 0) return 0;
+    l = stem_step_1a(w, l);
+    return stem_step_1b(w, l);
+}
+
+// Stems words through a reusable buffer, so nothing is allocated once the buffer fits the longest word
+class PorterStemmer {
+    char fixed[64];
+    std::vector<char> overflow;
+
+    public:
+        // Returns the stem of word, valid until the next call
+        std::string_view stem(std::string_view word) {
+            char* buffer = fixed;
+            if (word.size() > sizeof(fixed)) {
+                if (overflow.size() < word.size()) overflow.resize(word.size());
+                buffer = overflow.data();
+            }
+            memcpy(buffer, word.data(), word.size());
+            return std::string_view(buffer, stem_in_place(buffer, word.size()));
+        }
+};
+
+// Returns a mask with bit i set if finals[i] is a last character some suffix rule ends in ('d', 'g',
+// 's' or 'y'), for 32 bytes at a time
+inline uint32_t stem_candidates_scalar(const char* finals) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 32; i++) {
+        char c = finals[i];
+        if (c == 'd' || c == 'g' || c == 's' || c == 'y') mask |= (uint32_t) 1 << i;
+    }
+    return mask;
+}
+
+#if defined(__AVX2__)
+inline uint32_t stem_candidates(const char* finals) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) finals);
+    __m256i d = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('d'));
+    __m256i g = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('g'));
+    __m256i s = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('s'));
+    __m256i y = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('y'));
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(d, g), _mm256_or_si256(s, y)));
+}
+#else
+inline uint32_t stem_candidates(const char* finals) { return stem_candidates_scalar(finals); }
+#endif
+
+// Stems of many words computed in one call. The words are scanned 32 at a time with SIMD compares
+// of their last characters: a word no suffix rule can match is returned as a view of the word
+// itself, so the caller's words must outlive the stems, and the rest are copied into one arena and
+// stemmed there. Stem i stays valid until the next clear().
+class StemBatch {
+    std::string arena;
+    std::vector<std::string_view> stems;
+    std::vector<char> finals;       // Last character of each word, padded to a multiple of 32
+    size_t bytes = 0;
+
+    public:
+        // Forgets every word, keeping the memory
+        void clear() {
+            stems.clear();
+            finals.clear();
+            bytes = 0;
+        }
+
+        // Makes room for count words
+        void reserve(size_t count) {
+            stems.reserve(count);
+            finals.reserve((count + 31) / 32 * 32);
+        }
+
+        // Adds word to the batch without copying it and returns its index
+        size_t add(std::string_view word) {
+            stems.push_back(word);
+            finals.push_back(word.empty() ? 0 : word.back());
+            bytes += word.size();
+            return stems.size() - 1;
+        }
+
+        // Stems every word added since the last clear()
+        void stem() {
+            size_t count = stems.size();
+            finals.resize((count + 31) / 32 * 32, 0);
+            if (arena.size() < bytes) arena.resize(bytes);
+            char* out = &arena[0];
+            for (size_t base = 0; base < count; base += 32) {
+                for (uint32_t mask = stem_candidates(&finals[base]); mask; mask &= mask - 1) {
+                    std::string_view& word = stems[base + __builtin_ctz(mask)];
+                    memcpy(out, word.data(), word.size());
+                    size_t length = word.size();
+                    word = std::string_view(out, stem_in_place(out, length));
+                    out += length;
+                }
+            }
+            finals.resize(count);
+        }
+
+        // Returns the number of words in the batch
+        size_t size() const { return stems.size(); }
+
+        // Returns word i, stemmed once stem() has run
+        std::string_view operator[](size_t i) const { return stems[i]; }
+};
+
+// Stems count words into out, stem i being out[i]. The words must outlive the stems.
+inline void stem_batch(const std::string_view* words, size_t count, StemBatch& out) {
+    out.clear();
+    out.reserve(count);
+    for (size_t i = 0; i < count; i++) out.add(words[i]);
+    out.stem();
+}
+
+// Stems every string of words in place, in one batch
+inline void stem_strings(std::vector<std::string>& words, StemBatch& batch) {
+    batch.clear();
+    batch.reserve(words.size());
+    for (const std::string& w : words) batch.add(w);
+    batch.stem();
+    for (size_t i = 0; i < words.size(); i++) {
+        // Words no rule can match are still views of the strings themselves
+        if (batch[i].data() != words[i].data()) words[i].assign(batch[i].data(), batch[i].size());
+    }
+}
+
+#endif
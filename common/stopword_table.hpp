@@ -0,0 +1,209 @@
+/*
+ * Perfect-hash set of stopwords.
+ * Words are split into buckets by their hash, and each bucket gets a seed that sends its words to
+ * distinct empty slots (hash and displace). A lookup is one hash, two array reads and one compare.
+ * The same layout is built either at compile time into std::arrays (BUILTIN_STOPWORD_TABLE) or at
+ * runtime into vectors for custom lists, and both are queried through a PerfectHashView.
+ */
+
+#ifndef STOPWORD_TABLE_HPP
+#define STOPWORD_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <vector>
+#include "stopwords_list.hpp"
+
+// FNV-1a, usable in constant expressions
+constexpr uint64_t fnv1a(std::string_view word) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : word) h = (h ^ (uint8_t) c) * 0x100000001b3ULL;
+    return h;
+}
+
+// Slot of a word hash in its bucket's displacement
+constexpr uint64_t perfect_hash_slot(uint64_t h, uint32_t seed) {
+    return ((h ^ ((uint64_t) seed << 32)) * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+constexpr size_t next_power_of_two(size_t n) {
+    size_t p = 1;
+    while (p < n) p *= 2;
+    return p;
+}
+
+// Table sizes for a list of n words: load factor at most 1/2, about 4 words per bucket
+constexpr size_t perfect_hash_slots(size_t n) { return next_power_of_two(2 * n); }
+constexpr size_t perfect_hash_buckets(size_t n) { return next_power_of_two(n / 4 + 1); }
+
+// Longest bucket the builder accepts before giving up on the hash
+const size_t PERFECT_HASH_MAX_BUCKET = 32;
+
+// Read-only view of a built table, shared by the compile-time and runtime variants
+struct PerfectHashView {
+    const uint32_t* seeds = nullptr;
+    const uint32_t* offsets = nullptr;
+    const uint8_t* lengths = nullptr;
+    const char* pool = nullptr;
+    uint64_t bucket_mask = 0;
+    uint64_t slot_mask = 0;
+
+    constexpr bool contains(std::string_view word) const {
+        if (lengths == nullptr || word.empty()) return false;
+        uint64_t h = fnv1a(word);
+        uint64_t slot = perfect_hash_slot(h, seeds[h & bucket_mask]) & slot_mask;
+        return lengths[slot] == word.size() && std::string_view(pool + offsets[slot], word.size()) == word;
+    }
+};
+
+// Storage sized at compile time for at most WORDS words totalling POOL_BYTES bytes
+template <size_t WORDS, size_t POOL_BYTES>
+struct FixedHashStorage {
+    std::array<uint32_t, perfect_hash_buckets(WORDS)> seeds{};
+    std::array<uint32_t, perfect_hash_slots(WORDS)> offsets{};
+    std::array<uint8_t, perfect_hash_slots(WORDS)> lengths{};
+    std::array<char, POOL_BYTES + 1> pool{};
+
+    constexpr bool allocate(size_t words, size_t pool_bytes) { return words <= WORDS && pool_bytes <= POOL_BYTES; }
+};
+
+// Storage sized when the list is loaded
+struct DynamicHashStorage {
+    std::vector<uint32_t> seeds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint8_t> lengths;
+    std::vector<char> pool;
+
+    bool allocate(size_t words, size_t pool_bytes) {
+        seeds.assign(perfect_hash_buckets(words), 0);
+        offsets.assign(perfect_hash_slots(words), 0);
+        lengths.assign(perfect_hash_slots(words), 0);
+        pool.assign(pool_bytes + 1, 0);
+        return true;
+    }
+};
+
+template <class Storage>
+class PerfectHashSet {
+    Storage storage;
+    uint64_t bucket_mask = 0;
+    uint64_t slot_mask = 0;
+    size_t word_count = 0;
+    size_t pool_used = 0;
+
+    // Finds a seed that places every new word of the bucket in a free slot, then stores them
+    constexpr bool placeBucket(const std::string_view* words, size_t count, size_t bucket) {
+        std::array<size_t, PERFECT_HASH_MAX_BUCKET> members{};
+        size_t member_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (words[i].empty() || (fnv1a(words[i]) & bucket_mask) != bucket) continue;
+            // Duplicates in the list land in the same bucket, keep the first
+            bool duplicate = false;
+            for (size_t j = 0; j < member_count; j++) if (words[members[j]] == words[i]) duplicate = true;
+            if (duplicate) continue;
+            if (member_count == PERFECT_HASH_MAX_BUCKET || words[i].size() > 255) return false;
+            members[member_count++] = i;
+        }
+        if (member_count == 0) return true;
+
+        std::array<uint64_t, PERFECT_HASH_MAX_BUCKET> slots{};
+        for (uint32_t seed = 0; seed < (1u << 20); seed++) {
+            bool fits = true;
+            for (size_t j = 0; j < member_count && fits; j++) {
+                slots[j] = perfect_hash_slot(fnv1a(words[members[j]]), seed) & slot_mask;
+                if (storage.lengths[slots[j]] != 0) fits = false;
+                for (size_t k = 0; k < j && fits; k++) if (slots[k] == slots[j]) fits = false;
+            }
+            if (!fits) continue;
+
+            storage.seeds[bucket] = seed;
+            for (size_t j = 0; j < member_count; j++) {
+                std::string_view word = words[members[j]];
+                storage.offsets[slots[j]] = (uint32_t) pool_used;
+                storage.lengths[slots[j]] = (uint8_t) word.size();
+                for (char c : word) storage.pool[pool_used++] = c;
+                word_count++;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    public:
+        // Builds the table from a list of words, returns false if no perfect hash was found
+        constexpr bool build(const std::string_view* words, size_t count) {
+            size_t pool_bytes = 0;
+            for (size_t i = 0; i < count; i++) pool_bytes += words[i].size();
+            if (!storage.allocate(count, pool_bytes)) return false;
+            bucket_mask = perfect_hash_buckets(count) - 1;
+            slot_mask = perfect_hash_slots(count) - 1;
+
+            // Count bucket sizes in seeds (flagged as pending), then place the largest buckets first
+            // while most slots are still free
+            const uint32_t pending = 1u << 31;
+            uint32_t largest = 0;
+            for (size_t i = 0; i < count; i++) {
+                uint32_t& size = storage.seeds[fnv1a(words[i]) & bucket_mask];
+                size = (size + 1) | pending;
+                if ((size & ~pending) > largest) largest = size & ~pending;
+            }
+            for (uint32_t size = largest; size > 0; size--) {
+                for (size_t bucket = 0; bucket <= bucket_mask; bucket++) {
+                    if (storage.seeds[bucket] != (size | pending)) continue;
+                    storage.seeds[bucket] = 0;
+                    if (!placeBucket(words, count, bucket)) return false;
+                }
+            }
+            return true;
+        }
+
+        constexpr PerfectHashView view() const {
+            PerfectHashView v;
+            v.seeds = storage.seeds.data();
+            v.offsets = storage.offsets.data();
+            v.lengths = storage.lengths.data();
+            v.pool = storage.pool.data();
+            v.bucket_mask = bucket_mask;
+            v.slot_mask = slot_mask;
+            return v;
+        }
+
+        constexpr bool contains(std::string_view word) const { return view().contains(word); }
+
+        // Returns the number of distinct words in the table
+        constexpr size_t size() const { return word_count; }
+
+        // Returns the bytes held by the table
+        size_t memory() const {
+            return storage.seeds.size() * sizeof(uint32_t) + storage.offsets.size() * (sizeof(uint32_t) + sizeof(uint8_t)) + storage.pool.size();
+        }
+};
+
+constexpr size_t total_length(const std::string_view* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += words[i].size();
+    return total;
+}
+
+using BuiltinStopwordSet = PerfectHashSet<FixedHashStorage<std::size(BUILTIN_STOPWORDS),
+                                                           total_length(BUILTIN_STOPWORDS, std::size(BUILTIN_STOPWORDS))>>;
+
+constexpr BuiltinStopwordSet make_builtin_stopwords() {
+    BuiltinStopwordSet table;
+    table.build(BUILTIN_STOPWORDS, std::size(BUILTIN_STOPWORDS));
+    return table;
+}
+
+constexpr bool contains_all(const BuiltinStopwordSet& table, const std::string_view* words, size_t count) {
+    for (size_t i = 0; i < count; i++) if (!words[i].empty() && !table.contains(words[i])) return false;
+    return true;
+}
+
+// Built while compiling, the program only reads it
+constexpr BuiltinStopwordSet BUILTIN_STOPWORD_TABLE = make_builtin_stopwords();
+static_assert(contains_all(BUILTIN_STOPWORD_TABLE, BUILTIN_STOPWORDS, std::size(BUILTIN_STOPWORDS)),
+              "no perfect hash found for the builtin stopwords");
+
+#endif